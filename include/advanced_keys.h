@@ -49,14 +49,24 @@ typedef enum {
   TAP_HOLD_STAGE_NONE = 0,
   TAP_HOLD_STAGE_TAP,
   TAP_HOLD_STAGE_HOLD,
+  // The tap action is already performed, waiting for the key release
+  TAP_HOLD_STAGE_RELEASED,
 } ak_tap_hold_stage_t;
 
 // Tap-Hold state
 typedef struct {
   // Time when the key was pressed
   uint32_t since;
+  // Time when the key was pressed past the hold point
+  uint32_t deep_since;
+  // Time when the key travel distance was last sampled
+  uint32_t last_sample;
   // Tap-Hold stage
   uint8_t stage;
+  // Whether the key is pressed past the hold point
+  bool is_deep;
+  // Last sampled key travel distance
+  uint8_t last_distance;
 } ak_state_tap_hold_t;
 
 //--------------------------------------------------------------------+
@@ -81,17 +91,57 @@ typedef struct {
 } ak_state_toggle_t;
 
 //--------------------------------------------------------------------+
-// Advanced Key State
+// SOCD Group State
 //--------------------------------------------------------------------+
 
-// Advanced key state
+// SOCD group state. Keys are identified by their position in the group, where
+// 0 is the primary key.
+typedef struct {
+  // Active keycodes of the keys. `KC_NO` if the key is not pressed.
+  uint8_t keycodes[SOCD_GROUP_MAX_KEYS];
+  // Bitmask of the registered keys
+  uint8_t registered;
+  // Number of pressed keys
+  uint8_t num_pressed;
+  // Press order of the pressed keys, 4 bits per key position. The last pressed
+  // key is in the lowest 4 bits.
+  uint32_t order;
+} ak_state_socd_group_t;
+
+//--------------------------------------------------------------------+
+// Turbo State
+//--------------------------------------------------------------------+
+
+// Turbo state
+typedef struct {
+  // Time of the next press or release edge in microseconds
+  uint32_t next_edge;
+  // Whether the keycode is registered
+  bool is_pressed;
+} ak_state_turbo_t;
+
+//--------------------------------------------------------------------+
+// Advanced Key State Pools
+//--------------------------------------------------------------------+
+
+// Advanced key state. Only used to size the state pools.
 typedef union {
   ak_state_null_bind_t null_bind;
   ak_state_dynamic_keystroke_t dynamic_keystroke;
   ak_state_tap_hold_t tap_hold;
   ak_state_toggle_t toggle;
+  ak_state_socd_group_t socd_group;
+  ak_state_turbo_t turbo;
 } advanced_key_state_t;
 
+#if !defined(AK_STATE_POOL_SIZE)
+// Size of the advanced key state pools in bytes. Each advanced key type has its
+// own pool, packed back-to-back and sized for the advanced keys of that type in
+// the current profile. The default fits any profile. Boards may lower it to
+// save RAM, in which case the advanced keys that do not fit are ignored.
+#define AK_STATE_POOL_SIZE (NUM_ADVANCED_KEYS * sizeof(advanced_key_state_t))
+#endif
+
 //--------------------------------------------------------------------+
 // Advanced Key Event
 //--------------------------------------------------------------------+
@@ -106,6 +156,17 @@ typedef enum {
   AK_EVENT_TYPE_RELEASE,
 } ak_event_type_t;
 
+// Hold event subscription. Each advanced key declares whether it needs the
+// `AK_EVENT_TYPE_HOLD` events while its key is held.
+typedef enum {
+  // No hold events
+  AK_HOLD_SUBSCRIPTION_NONE = 0,
+  // Hold events only when the key travel distance changes
+  AK_HOLD_SUBSCRIPTION_ON_CHANGE,
+  // Hold events on every matrix scan
+  AK_HOLD_SUBSCRIPTION_EVERY_SCAN,
+} ak_hold_subscription_t;
+
 // Advanced key event
 typedef struct {
   // Key event type
@@ -129,6 +190,18 @@ typedef struct {
  */
 void advanced_key_init(void);
 
+/**
+ * @brief Load the advanced key state pools
+ *
+ * This function assigns each advanced key of the current profile to a slot in
+ * the state pool of its type. It should be called after the advanced key
+ * states are cleared, whenever the profile changes or the advanced keys are
+ * updated.
+ *
+ * @return None
+ */
+void advanced_key_load(void);
+
 /**
  * @brief Clear advanced key states
  *
@@ -139,6 +212,15 @@ void advanced_key_init(void);
  */
 void advanced_key_clear(void);
 
+/**
+ * @brief Get the hold event subscription of an advanced key
+ *
+ * @param ak Advanced key configuration
+ *
+ * @return Hold event subscription
+ */
+uint8_t advanced_key_hold_subscription(const advanced_key_t *ak);
+
 /**
  * @brief Process an advanced key event
  *
@@ -148,11 +230,55 @@ void advanced_key_clear(void);
  */
 void advanced_key_process(const advanced_key_event_t *event);
 
+/**
+ * @brief Check whether a permissive hold Tap-Hold key is undecided
+ *
+ * While this function returns true, the other key events should be buffered
+ * until the Tap-Hold key is resolved.
+ *
+ * @return true if a Tap-Hold key with permissive hold is in the tap stage,
+ * false otherwise
+ */
+bool advanced_key_has_permissive_hold(void);
+
+/**
+ * @brief Check whether an advanced key is an undecided permissive hold
+ * Tap-Hold key
+ *
+ * @param ak_index Advanced key index
+ *
+ * @return true if the advanced key is a Tap-Hold key with permissive hold in
+ * the tap stage, false otherwise
+ */
+bool advanced_key_is_permissive_hold(uint8_t ak_index);
+
+/**
+ * @brief Resolve the undecided permissive hold Tap-Hold keys to hold
+ *
+ * This function should be called when a buffered key is released while the
+ * Tap-Hold keys are still held.
+ *
+ * @return None
+ */
+void advanced_key_permissive_hold(void);
+
+/**
+ * @brief Check whether an advanced key timer has expired
+ *
+ * This function only compares the earliest armed deadline to the current time
+ * so it can be called on every matrix scan.
+ *
+ * @return true if `advanced_key_tick()` has a timer to fire, false otherwise
+ */
+bool advanced_key_timer_expired(void);
+
 /**
  * @brief Advanced key tick
  *
- * This function is called periodically to update the time-based advanced keys
- * (e.g., Tap-Hold and Toggle keys).
+ * This function updates the time-based advanced keys (e.g., Tap-Hold and
+ * Toggle keys). It should be called when a timer has expired, or when there is
+ * a non-Tap-Hold key press. Only the armed timers are visited so the cost does
+ * not depend on the number of configured advanced keys.
  *
  * @param has_non_tap_hold_press Whether there is a non-Tap-Hold key press
  *
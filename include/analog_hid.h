@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Analog HID Report
+//--------------------------------------------------------------------+
+
+#if defined(ANALOG_HID_ENABLED)
+// Maximum number of keys in an analog HID report
+#define ANALOG_HID_MAX_ENTRIES 31
+
+// Analog HID report. Only the keys whose distance changed since they were last
+// sent are included, so the host must keep the last distance of each key. When
+// there is room left, unchanged keys are sent in turn so that the host state
+// converges even if it missed a report.
+typedef struct __attribute__((packed)) {
+  // Number of valid entries
+  uint8_t num_entries;
+  struct __attribute__((packed)) {
+    // Key index
+    uint8_t key;
+    // Key travel distance (0-255)
+    uint8_t distance;
+  } entries[ANALOG_HID_MAX_ENTRIES];
+} analog_hid_report_t;
+
+//--------------------------------------------------------------------+
+// Analog HID API
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Initialize the analog HID module
+ *
+ * Every key is streamed by default.
+ *
+ * @return None
+ */
+void analog_hid_init(void);
+
+/**
+ * @brief Select the keys to stream
+ *
+ * This function is called when the host sends an output report to the analog
+ * HID interface.
+ *
+ * @param buf Bitmap of the keys to stream, bit `i` of byte `i / 8` for key `i`
+ * @param len Length of the bitmap in bytes. Missing bytes are treated as 0.
+ *
+ * @return None
+ */
+void analog_hid_set_keys(const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Analog HID task
+ *
+ * This function sends an analog HID report whenever the analog HID interface
+ * is ready, so the host receives one on every poll.
+ *
+ * @return None
+ */
+void analog_hid_task(void);
+#endif
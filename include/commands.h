@@ -17,8 +17,36 @@
 
 #include "common.h"
 #include "eeconfig.h"
+#include "latency.h"
 #include "usb_descriptors.h"
 
+//--------------------------------------------------------------------+
+// Command Configuration
+//--------------------------------------------------------------------+
+
+#if !defined(MAX_QUEUED_COMMANDS)
+// Capacity of the queue of command buffers received from the raw HID interface
+// waiting to be executed
+#define MAX_QUEUED_COMMANDS 4
+#endif
+
+_Static_assert(M_IS_POWER_OF_TWO(MAX_QUEUED_COMMANDS),
+               "MAX_QUEUED_COMMANDS must be a power of two");
+
+#if !defined(WRITE_SESSION_BUFFER_SIZE)
+// Size of the RAM buffer in which a write session is staged, which bounds the
+// length of the session. By default, a whole profile fits in one session.
+#define WRITE_SESSION_BUFFER_SIZE sizeof(eeconfig_profile_t)
+#endif
+
+// Number of bytes of each chunk of a write session
+#define WRITE_SESSION_CHUNK_SIZE 60
+
+#if !defined(ANALOG_STREAM_TIMEOUT_MS)
+// Time without any command from the host after which the analog stream stops
+#define ANALOG_STREAM_TIMEOUT_MS 1000
+#endif
+
 //--------------------------------------------------------------------+
 // Commands
 //--------------------------------------------------------------------+
@@ -38,6 +66,18 @@ typedef enum {
   COMMAND_RESET_PROFILE,
   COMMAND_DUPLICATE_PROFILE,
   COMMAND_GET_METADATA,
+  COMMAND_GET_MACROS,
+  COMMAND_SET_MACROS,
+  COMMAND_READ_CONFIG,
+  COMMAND_WRITE_CONFIG,
+  COMMAND_GET_LATENCY,
+  COMMAND_SUBSCRIBE_ANALOG,
+  // Sent by the device to push an analog stream frame. Never sent by the host.
+  COMMAND_ANALOG_FRAME,
+  COMMAND_WRITE_SESSION_BEGIN,
+  COMMAND_WRITE_SESSION_DATA,
+  COMMAND_WRITE_SESSION_COMMIT,
+  COMMAND_GET_DIGEST,
 
   COMMAND_GET_KEYMAP = 128,
   COMMAND_SET_KEYMAP,
@@ -51,6 +91,8 @@ typedef enum {
   COMMAND_SET_GAMEPAD_BUTTONS,
   COMMAND_GET_GAMEPAD_OPTIONS,
   COMMAND_SET_GAMEPAD_OPTIONS,
+  COMMAND_GET_MOUSE_OPTIONS,
+  COMMAND_SET_MOUSE_OPTIONS,
 
   COMMAND_UNKNOWN = 255,
 } command_id_t;
@@ -80,6 +122,59 @@ typedef struct __attribute__((packed)) {
   uint32_t offset;
 } command_in_metadata_t;
 
+typedef struct __attribute__((packed)) {
+  uint16_t offset;
+  uint8_t len;
+  uint8_t macros[60];
+} command_in_macros_t;
+
+// Raw access to the persistent configuration, used to dump and restore it.
+// Over the vendor interface, `len` may exceed the command buffer and the data
+// of `COMMAND_WRITE_CONFIG` continues in the rest of the frame.
+typedef struct __attribute__((packed)) {
+  uint16_t offset;
+  uint16_t len;
+  uint8_t data[59];
+} command_in_config_t;
+
+// Subscription to the analog stream. The ADC value and the distance of the keys
+// that changed are pushed over the raw HID interface every `interval_us`, as
+// `COMMAND_ANALOG_FRAME` reports. A key is considered changed if its distance
+// changed, or if its ADC value changed by more than `adc_threshold`. The stream
+// starts with every key, and stops if `interval_us` is 0, or if no command is
+// received for `ANALOG_STREAM_TIMEOUT_MS`.
+typedef struct __attribute__((packed)) {
+  uint16_t interval_us;
+  uint16_t adc_threshold;
+} command_in_analog_stream_t;
+
+typedef struct __attribute__((packed)) {
+  // Histogram ID (see `latency_histogram_id_t`)
+  uint8_t histogram;
+  // Whether to clear the histogram after reading it
+  bool reset;
+} command_in_latency_t;
+
+// Write session. `COMMAND_WRITE_SESSION_BEGIN` starts a session that writes
+// `len` bytes at `offset` in the persistent configuration. The data is sent in
+// chunks of `WRITE_SESSION_CHUNK_SIZE` bytes, the n-th chunk starting at byte
+// `n * WRITE_SESSION_CHUNK_SIZE` of the session, and staged in RAM.
+// `COMMAND_WRITE_SESSION_COMMIT` then writes the whole session at once, and
+// fails if a chunk is missing. Starting a session discards the previous one.
+typedef struct __attribute__((packed)) {
+  uint16_t offset;
+  uint16_t len;
+} command_in_write_session_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t sequence;
+  uint8_t data[WRITE_SESSION_CHUNK_SIZE];
+} command_in_write_session_data_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t offset;
+} command_in_digest_t;
+
 typedef struct __attribute__((packed)) {
   uint8_t profile;
   uint8_t layer;
@@ -119,6 +214,11 @@ typedef struct __attribute__((packed)) {
   gamepad_options_t gamepad_options;
 } command_in_gamepad_options_t;
 
+typedef struct __attribute__((packed)) {
+  uint8_t profile;
+  mouse_options_t mouse_options;
+} command_in_mouse_options_t;
+
 // Command input buffer type
 typedef struct __attribute__((packed)) {
   uint8_t command_id;
@@ -129,6 +229,13 @@ typedef struct __attribute__((packed)) {
     command_in_reset_profile_t reset_profile;
     command_in_duplicate_profile_t duplicate_profile;
     command_in_metadata_t metadata;
+    command_in_macros_t macros;
+    command_in_config_t config;
+    command_in_latency_t latency;
+    command_in_analog_stream_t analog_stream;
+    command_in_write_session_t write_session;
+    command_in_write_session_data_t write_session_data;
+    command_in_digest_t digest;
 
     command_in_keymap_t keymap;
     command_in_actuation_map_t actuation_map;
@@ -136,6 +243,7 @@ typedef struct __attribute__((packed)) {
     command_in_tick_rate_t tick_rate;
     command_in_gamepad_buttons_t gamepad_buttons;
     command_in_gamepad_options_t gamepad_options;
+    command_in_mouse_options_t mouse_options;
   };
 } command_in_buffer_t;
 
@@ -156,6 +264,39 @@ typedef struct __attribute__((packed)) {
   uint8_t metadata[59];
 } command_out_metadata_t;
 
+typedef struct __attribute__((packed)) {
+  uint8_t key;
+  command_out_analog_info_t analog_info;
+} command_out_analog_entry_t;
+
+// Write session state, returned by every write session command. The chunks
+// may be sent out of order, and a chunk is sent again if its response does not
+// acknowledge it.
+typedef struct __attribute__((packed)) {
+  // Sequence number of the first chunk not received yet. Every chunk before it
+  // has been received.
+  uint16_t next_sequence;
+  // Maximum number of commands that the host may send without waiting for
+  // their responses
+  uint8_t window;
+} command_out_write_session_t;
+
+// Digests of the configuration sections starting from the requested offset.
+// See `eeconfig_digest()` for the sections.
+typedef struct __attribute__((packed)) {
+  // Total number of sections
+  uint8_t num_sections;
+  uint32_t digests[15];
+} command_out_digest_t;
+
+// A stream frame may span several reports with the same frame number if more
+// keys changed than fit in one report
+typedef struct __attribute__((packed)) {
+  uint8_t frame_number;
+  uint8_t num_entries;
+  command_out_analog_entry_t entries[15];
+} command_out_analog_frame_t;
+
 // Command output buffer type
 typedef struct __attribute__((packed)) {
   uint8_t command_id;
@@ -172,6 +313,19 @@ typedef struct __attribute__((packed)) {
     eeconfig_options_t options;
     // For `COMMAND_GET_METADATA`
     command_out_metadata_t metadata;
+    // For `COMMAND_GET_MACROS`
+    uint8_t macros[63];
+    // For `COMMAND_READ_CONFIG`
+    uint8_t config[63];
+    // For `COMMAND_GET_LATENCY`
+    latency_histogram_t latency;
+    // For `COMMAND_ANALOG_FRAME`
+    command_out_analog_frame_t analog_frame;
+    // For `COMMAND_WRITE_SESSION_BEGIN`, `COMMAND_WRITE_SESSION_DATA` and
+    // `COMMAND_WRITE_SESSION_COMMIT`
+    command_out_write_session_t write_session;
+    // For `COMMAND_GET_DIGEST`
+    command_out_digest_t digest;
 
     // For `COMMAND_GET_KEYMAP`
     uint8_t keymap[63];
@@ -185,6 +339,8 @@ typedef struct __attribute__((packed)) {
     uint8_t gamepad_buttons[63];
     // For `COMMAND_GET_GAMEPAD_OPTIONS`
     gamepad_options_t gamepad_options;
+    // For `COMMAND_GET_MOUSE_OPTIONS`
+    mouse_options_t mouse_options;
   };
 } command_out_buffer_t;
 
@@ -203,10 +359,68 @@ _Static_assert(sizeof(command_out_buffer_t) <= RAW_HID_EP_SIZE,
 void command_init(void);
 
 /**
- * @brief Process a command buffer received from the raw HID interface
+ * @brief Execute a command
+ *
+ * @param in_buf Command buffer of `RAW_HID_EP_SIZE` bytes
+ * @param out_buf Response buffer of `RAW_HID_EP_SIZE` bytes
+ *
+ * @return true if the device must be enumerated again after the response is
+ * sent, false otherwise
+ */
+bool command_execute(const uint8_t *in_buf, uint8_t *out_buf);
+
+/**
+ * @brief Write raw data to the persistent configuration
+ *
+ * The data is written at once, and the state derived from the configuration is
+ * reloaded after the write. The write is rejected if it changes the magic
+ * numbers or the version, or sets an invalid profile index.
+ *
+ * @param offset Offset in the persistent configuration
+ * @param buf Data to write
+ * @param len Length of the data in bytes
+ * @param should_reenumerate Set to true if the write changed an option of the
+ * configuration descriptor, so the device must be enumerated again after the
+ * response is sent
+ *
+ * @return true if successful, false otherwise
+ */
+bool command_write_config(uint32_t offset, const void *buf, uint32_t len,
+                          bool *should_reenumerate);
+
+/**
+ * @brief Enumerate the device again
+ *
+ * This function should be called once the response of a command for which
+ * `command_execute()` returned true has been sent.
+ *
+ * @return None
+ */
+void command_reenumerate(void);
+
+/**
+ * @brief Queue a command buffer received from the raw HID interface
+ *
+ * The command is executed later by `command_task()`, outside of the USB
+ * callbacks. If the queue is full, the command is rejected with a
+ * `COMMAND_UNKNOWN` response instead.
+ *
+ * @param buf Command buffer
+ * @param len Length of the command buffer in bytes
+ *
+ * @return None
+ */
+void command_process(const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Command task
  *
- * @param in_buf Command buffer
+ * This function executes at most one queued command per call, when the raw
+ * HID interface is ready to take its response, so that the matrix scan keeps
+ * running between commands and never waits for the host. It also enumerates
+ * the device again once the response of a command that requires it has been
+ * sent, and pushes the analog stream when no command is waiting.
  *
  * @return None
  */
-void command_process(const uint8_t *buf);
+void command_task(void);
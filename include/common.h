@@ -109,6 +109,8 @@ typedef enum {
   AK_TYPE_DYNAMIC_KEYSTROKE,
   AK_TYPE_TAP_HOLD,
   AK_TYPE_TOGGLE,
+  AK_TYPE_SOCD_GROUP,
+  AK_TYPE_TURBO,
   AK_TYPE_COUNT,
 } ak_type_t;
 
@@ -167,6 +169,20 @@ typedef struct __attribute__((packed)) {
   // Whether to immediately register the hold action if another non-Tap-Hold key
   // is pressed, regardless of the tapping term
   bool hold_on_other_key_press;
+  // Hold point (0-255). If non-zero, the hold action is registered once the key
+  // is pressed past this point for `hold_dwell` milliseconds, regardless of the
+  // tapping term.
+  uint8_t hold_point;
+  // Time in milliseconds the key must stay past the hold point
+  uint8_t hold_dwell;
+  // Tap release velocity in distance units (0-255) per millisecond. If
+  // non-zero, the tap action is registered as soon as the key travels up at
+  // least this fast, without waiting for the key release.
+  uint8_t tap_release_velocity;
+  // Whether to immediately register the hold action if another key is pressed
+  // and released while the Tap-Hold key is held, regardless of the tapping
+  // term. The other key events are delayed until the Tap-Hold key is resolved.
+  bool permissive_hold;
 } tap_hold_t;
 
 // Toggle configuration
@@ -176,6 +192,44 @@ typedef struct __attribute__((packed)) {
   uint16_t tapping_term;
 } toggle_t;
 
+// Maximum number of keys in a SOCD group, including the primary key
+#define SOCD_GROUP_MAX_KEYS 8
+
+// SOCD group resolution behavior when multiple keys in the group are pressed
+// at the same time
+typedef enum {
+  // Prioritize the last pressed key
+  SOCD_BEHAVIOR_LAST = 0,
+  // Prioritize the first pressed key
+  SOCD_BEHAVIOR_FIRST,
+  // Release all keys
+  SOCD_BEHAVIOR_NEUTRAL,
+  // Prioritize the key that is pressed furthest
+  SOCD_BEHAVIOR_DISTANCE,
+} socd_behavior_t;
+
+// SOCD group configuration. The primary key is the advanced key `key`.
+typedef struct __attribute__((packed)) {
+  // Other keys in the group. Unused entries must be set to a value greater
+  // than or equal to `NUM_KEYS`.
+  uint8_t keys[SOCD_GROUP_MAX_KEYS - 1];
+  uint8_t behavior;
+  // Bottom-out point (0-255). If non-zero, all the keys pressed past this point
+  // will be registered if at least two of them are, regardless of the
+  // behavior.
+  uint8_t bottom_out_point;
+} socd_group_t;
+
+// Turbo configuration
+typedef struct __attribute__((packed)) {
+  uint8_t keycode;
+  // Period of the press and release cycle in microseconds
+  uint32_t period_us;
+  // Percentage of the period the key is registered (1-99). Other values are
+  // treated as 50.
+  uint8_t duty_cycle;
+} turbo_t;
+
 // Advanced key configuration
 typedef struct __attribute__((packed)) {
   uint8_t layer;
@@ -186,6 +240,8 @@ typedef struct __attribute__((packed)) {
     dynamic_keystroke_t dynamic_keystroke;
     tap_hold_t tap_hold;
     toggle_t toggle;
+    socd_group_t socd_group;
+    turbo_t turbo;
   };
 } advanced_key_t;
 
@@ -246,3 +302,14 @@ typedef struct __attribute__((packed)) {
     uint8_t options;
   };
 } gamepad_options_t;
+
+// Mouse options configuration
+typedef struct __attribute__((packed)) {
+  // 4 points that define the analog curve, representing the relationship
+  // between the key position and the mouse speed
+  uint8_t analog_curve[4][2];
+  // Cursor speed at full speed in units of 10 pixels per second
+  uint8_t speed;
+  // Wheel speed at full speed in notches per second
+  uint8_t wheel_speed;
+} mouse_options_t;
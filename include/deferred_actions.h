@@ -22,13 +22,28 @@
 //--------------------------------------------------------------------+
 
 #if !defined(MAX_DEFERRED_ACTIONS)
-// Maximum number of deferred actions for each matrix scan
+// Capacity of the deferred action queue
 #define MAX_DEFERRED_ACTIONS 16
 #endif
 
 _Static_assert(M_IS_POWER_OF_TWO(MAX_DEFERRED_ACTIONS),
                "MAX_DEFERRED_ACTIONS must be a power of two");
 
+#if !defined(MAX_SPILLED_DEFERRED_ACTIONS)
+// Capacity of the spill queue, which holds release actions that did not fit in
+// the deferred action queue
+#define MAX_SPILLED_DEFERRED_ACTIONS 8
+#endif
+
+_Static_assert(M_IS_POWER_OF_TWO(MAX_SPILLED_DEFERRED_ACTIONS),
+               "MAX_SPILLED_DEFERRED_ACTIONS must be a power of two");
+
+#if !defined(DEFERRED_ACTION_TICK_US)
+// Duration of a tick in microseconds. The profile `tick_rate` is converted to
+// a delay with this duration, which is one matrix scan at 8kHz.
+#define DEFERRED_ACTION_TICK_US 125
+#endif
+
 // Deferred action type
 typedef enum {
   DEFERRED_ACTION_TYPE_NONE = 0,
@@ -38,8 +53,9 @@ typedef enum {
   DEFERRED_ACTION_TYPE_COUNT,
 } deferred_action_type_t;
 
-// Deferred action. The action will be deferred to the next matrix scan. This is
-// necessary to implement features like tapping keys and DKS.
+// Deferred action. The action will be deferred by the tick rate of the current
+// profile, converted to microseconds, or by one USB frame if frame sync is
+// enabled. This is necessary to implement features like tapping keys and DKS.
 typedef struct {
   // Action to perform
   uint8_t type;
@@ -47,8 +63,9 @@ typedef struct {
   uint8_t key;
   // Keycode associated with the action
   uint8_t keycode;
-  // Number of matrix scans to wait before executing the action
-  uint8_t ticks;
+  // Time in microseconds, or USB frame count, when the action should be
+  // executed. Set by `deferred_action_push()`.
+  uint32_t deadline;
 } deferred_action_t;
 
 //--------------------------------------------------------------------+
@@ -63,10 +80,14 @@ typedef struct {
 void deferred_action_init(void);
 
 /**
- * @brief Push a deferred action to the stack
+ * @brief Push a deferred action to the queue
  *
- * The action may not be pushed if the stack is locked or full. The stack is
- * locked if it is being processed.
+ * The queue is a single-producer single-consumer ring, so this function may be
+ * called from an interrupt handler as long as every push comes from the same
+ * context. A release action that does not fit in the queue is moved to the
+ * spill queue instead. Any other action is rejected when the queue is full,
+ * and the caller must not perform the part of the action that the deferred
+ * action would undo.
  *
  * @param action Deferred action
  *
@@ -75,7 +96,20 @@ void deferred_action_init(void);
 bool deferred_action_push(const deferred_action_t *action);
 
 /**
- * @brief Process all deferred actions and clear the stack
+ * @brief Get the number of pushes that did not fit in the deferred action queue
+ *
+ * This includes the release actions that were moved to the spill queue.
+ *
+ * @return Overflow count
+ */
+uint32_t deferred_action_overflow_count(void);
+
+/**
+ * @brief Process the deferred actions whose deadline has been reached
+ *
+ * This function must be called from a single context, which is the consumer of
+ * the deferred action queue. Actions pushed while processing, such as the
+ * release of a tap, are processed in the next call.
  *
  * @return None
  */
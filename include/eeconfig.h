@@ -16,6 +16,7 @@
 #pragma once
 
 #include "common.h"
+#include "macro.h"
 #include "wear_leveling.h"
 
 //--------------------------------------------------------------------+
@@ -25,7 +26,7 @@
 // Persistent configuration version. The size of the configuration must be
 // non-decreasing, so that the migration can assume that the new version is at
 // least as large as the previous version.
-#define EECONFIG_VERSION 0x0101
+#define EECONFIG_VERSION 0x0102
 // Magic number to identify the start of the configuration
 #define EECONFIG_MAGIC_START 0x0A42494C
 // Magic number to identify the end of the configuration
@@ -46,13 +47,33 @@ typedef struct __attribute__((packed)) {
   uint16_t initial_bottom_out_threshold;
 } eeconfig_calibration_t;
 
+// USB polling rate of an interface. Rates above 1kHz require USB high-speed,
+// and are lowered to 1kHz on full-speed.
+typedef enum {
+  USB_POLLING_RATE_8000HZ = 0,
+  USB_POLLING_RATE_4000HZ,
+  USB_POLLING_RATE_2000HZ,
+  USB_POLLING_RATE_1000HZ,
+} usb_polling_rate_t;
+
 // Keyboard options configuration
 typedef union __attribute__((packed)) {
   struct __attribute__((packed)) {
     // Whether the XInput interface is enabled
     bool xinput_enabled : 1;
+    // Whether the deferred actions are timed in USB frames instead of the tick
+    // rate, so that a tap is released in the report following its press
+    bool frame_sync_enabled : 1;
+    // Whether the reports are submitted just before the next USB frame, so
+    // that they carry the most recent matrix scan when the host reads them
+    bool phase_lock_enabled : 1;
+    // Polling rate of each interface. See `usb_polling_rate_t`.
+    uint16_t keyboard_polling_rate : 2;
+    uint16_t hid_polling_rate : 2;
+    uint16_t raw_hid_polling_rate : 2;
+    uint16_t xinput_polling_rate : 2;
     // Reserved bits for future use
-    uint16_t reserved : 15;
+    uint16_t reserved : 5;
   };
   uint16_t raw;
 } eeconfig_options_t;
@@ -65,6 +86,7 @@ typedef struct __attribute__((packed)) {
   uint8_t gamepad_buttons[NUM_KEYS];
   gamepad_options_t gamepad_options;
   uint8_t tick_rate;
+  mouse_options_t mouse_options;
 } eeconfig_profile_t;
 
 // Keyboard configuration
@@ -84,6 +106,8 @@ typedef struct __attribute__((packed)) {
   uint8_t current_profile;
   // Last non-default profile index, used for profile swapping
   uint8_t last_non_default_profile;
+  // Macro bytecode shared by all profiles. See `macro_op_t`.
+  uint8_t macros[MACRO_BUFFER_SIZE];
   // End of global configurations
 
   // Profiles
@@ -111,7 +135,16 @@ extern const eeconfig_t *eeconfig;
 
 #if !defined(DEFAULT_OPTIONS)
 // Default global options
-#define DEFAULT_OPTIONS {.xinput_enabled = false}
+#define DEFAULT_OPTIONS                                                        \
+  {                                                                            \
+      .xinput_enabled = false,                                                 \
+      .frame_sync_enabled = false,                                             \
+      .phase_lock_enabled = false,                                             \
+      .keyboard_polling_rate = USB_POLLING_RATE_8000HZ,                        \
+      .hid_polling_rate = USB_POLLING_RATE_8000HZ,                             \
+      .raw_hid_polling_rate = USB_POLLING_RATE_8000HZ,                         \
+      .xinput_polling_rate = USB_POLLING_RATE_1000HZ,                          \
+  }
 #endif
 
 #if !defined(DEFAULT_KEYMAP)
@@ -134,10 +167,50 @@ extern const eeconfig_t *eeconfig;
 #endif
 
 #if !defined(DEFAULT_TICK_RATE)
-// Default tick rate
+// Default tick rate. Each tick lasts `DEFERRED_ACTION_TICK_US` microseconds.
 #define DEFAULT_TICK_RATE 30
 #endif
 
+#if !defined(DEFAULT_MOUSE_OPTIONS)
+// Default mouse options
+#define DEFAULT_MOUSE_OPTIONS                                                  \
+  {                                                                            \
+      .analog_curve = {{4, 20}, {85, 95}, {165, 170}, {255, 255}},             \
+      .speed = 100,                                                            \
+      .wheel_speed = 20,                                                       \
+  }
+#endif
+
+//--------------------------------------------------------------------+
+// Configuration Digests
+//--------------------------------------------------------------------+
+
+// Sections of the persistent configuration with a digest. The global sections
+// come first, followed by `EECONFIG_NUM_PROFILE_SECTIONS` sections for each
+// profile.
+typedef enum {
+  // Calibration, options and profile indices
+  EECONFIG_SECTION_SETTINGS = 0,
+  EECONFIG_SECTION_MACROS,
+  EECONFIG_NUM_GLOBAL_SECTIONS,
+} eeconfig_global_section_t;
+
+typedef enum {
+  EECONFIG_SECTION_KEYMAP = 0,
+  EECONFIG_SECTION_ACTUATION_MAP,
+  EECONFIG_SECTION_ADVANCED_KEYS,
+  EECONFIG_SECTION_GAMEPAD_BUTTONS,
+  // Gamepad options, tick rate and mouse options
+  EECONFIG_SECTION_PROFILE_OPTIONS,
+  EECONFIG_NUM_PROFILE_SECTIONS,
+} eeconfig_profile_section_t;
+
+// Total number of sections with a digest
+#define EECONFIG_NUM_SECTIONS                                                  \
+  (EECONFIG_NUM_GLOBAL_SECTIONS + NUM_PROFILES * EECONFIG_NUM_PROFILE_SECTIONS)
+
+_Static_assert(EECONFIG_NUM_SECTIONS <= 255, "Too many configuration sections");
+
 //--------------------------------------------------------------------+
 // Persistent Configuration API
 //--------------------------------------------------------------------+
@@ -156,6 +229,13 @@ void eeconfig_init(void);
  */
 bool eeconfig_reset(void);
 
+/**
+ * @brief Reset the macro buffer so that every macro is empty
+ *
+ * @return true if successful, false otherwise
+ */
+bool eeconfig_reset_macros(void);
+
 /**
  * @brief Reset a specific profile to default values
  *
@@ -165,6 +245,19 @@ bool eeconfig_reset(void);
  */
 bool eeconfig_reset_profile(uint8_t profile);
 
+/**
+ * @brief Get the digest of a section of the persistent configuration
+ *
+ * The digest is the CRC32 of the section. It is cached until the section is
+ * written. Since the CRC32 implementation may differ between boards, digests
+ * should only be compared with digests returned by the same keyboard.
+ *
+ * @param section Section index (see `EECONFIG_NUM_SECTIONS`)
+ *
+ * @return Digest of the section
+ */
+uint32_t eeconfig_digest(uint32_t section);
+
 /**
  * @brief Write a value to a field in the persistent configuration
  *
@@ -110,3 +110,12 @@ void analog_task(void);
  * @return Raw ADC value
  */
 uint16_t analog_read(uint8_t key);
+
+/**
+ * @brief Get the time of the last complete ADC frame
+ *
+ * An ADC frame is complete when the ADC values of every key have been updated.
+ *
+ * @return Cycle count (see `board_cycle_count()`) at the end of the last frame
+ */
+uint32_t analog_frame_time(void);
@@ -35,6 +35,16 @@ void timer_init(void);
  */
 uint32_t timer_read(void);
 
+/**
+ * @brief Read the current timer value in microseconds
+ *
+ * The value wraps around every 2^32 microseconds, so it should only be
+ * compared with wrap-around safe arithmetic.
+ *
+ * @return Current timer value in microseconds
+ */
+uint32_t timer_read_us(void);
+
 /**
  * @brief Get the elapsed time since a given time
  *
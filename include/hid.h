@@ -17,6 +17,32 @@
 
 #include "common.h"
 
+//--------------------------------------------------------------------+
+// HID Configuration
+//--------------------------------------------------------------------+
+
+#if !defined(MAX_QUEUED_KEYBOARD_REPORTS)
+// Maximum number of keyboard reports closed by `hid_report_barrier()` waiting
+// to be sent
+#define MAX_QUEUED_KEYBOARD_REPORTS 8
+#endif
+
+_Static_assert(M_IS_POWER_OF_TWO(MAX_QUEUED_KEYBOARD_REPORTS),
+               "MAX_QUEUED_KEYBOARD_REPORTS must be a power of two");
+
+#if !defined(HID_PHASE_LOCK_LEAD_US)
+// Time before the expected start of the next USB frame from which the reports
+// are submitted when phase lock is enabled. It must be longer than one
+// iteration of the main loop so that every frame gets a submission.
+#define HID_PHASE_LOCK_LEAD_US 250
+#endif
+
+#if !defined(HID_REMOTE_WAKEUP_RETRY_MS)
+// Time after which the remote wakeup is signaled again if the host has not
+// resumed the bus
+#define HID_REMOTE_WAKEUP_RETRY_MS 100
+#endif
+
 //--------------------------------------------------------------------+
 // HID API
 //--------------------------------------------------------------------+
@@ -46,11 +72,82 @@ void hid_keycode_add(uint8_t keycode);
  */
 void hid_keycode_remove(uint8_t keycode);
 
+/**
+ * @brief Close the current keyboard report
+ *
+ * The keyboard report is queued as it is now, and the following keycode
+ * changes go to the next report. This allows a keycode to be released and
+ * pressed again, or pressed and released, within the same matrix scan while
+ * the host still observes both edges in consecutive reports. Nothing is queued
+ * if the keyboard report has not changed since the last closed or sent report.
+ *
+ * @return true if successful, false if the queue is full
+ */
+bool hid_report_barrier(void);
+
+/**
+ * @brief Add relative movement to the mouse report
+ *
+ * The movement is accumulated until it is sent. This function does not block,
+ * and sends the mouse report if the HID interface is ready.
+ *
+ * @param x Cursor movement in the X axis
+ * @param y Cursor movement in the Y axis
+ * @param wheel Vertical wheel movement
+ * @param pan Horizontal wheel movement
+ *
+ * @return None
+ */
+void hid_mouse_move(int32_t x, int32_t y, int32_t wheel, int32_t pan);
+
+/**
+ * @brief Check whether the HID reports can be sent without blocking
+ *
+ * @return true if the keyboard and HID interfaces are ready and the reports
+ * have been submitted, false otherwise
+ */
+bool hid_ready(void);
+
+/**
+ * @brief Get the number of USB start-of-frame events received
+ *
+ * The count only advances while the host is polling the device. See
+ * `hid_frame_count_active()`.
+ *
+ * @return Frame count
+ */
+uint32_t hid_frame_count(void);
+
+/**
+ * @brief Check whether the USB frame count is advancing
+ *
+ * @return true if the device is mounted and not suspended, and frame sync or
+ * phase lock is enabled, false otherwise
+ */
+bool hid_frame_count_active(void);
+
 /**
  * @brief Send all HID reports
  *
- * This function will block until the device is ready to send the reports.
+ * This function does not block. Each interface keeps the latest report state,
+ * which is submitted now if the interface is ready, or as soon as it becomes
+ * ready by `hid_task()` or when the previous report completes. The keyboard
+ * reports closed by `hid_report_barrier()` are sent first, in order.
+ *
+ * If the host is suspended, this function signals a remote wakeup and, if the
+ * host allows it, closes the keyboard report so that the changes of each scan
+ * are replayed in order once the bus has resumed.
  *
  * @return None
  */
 void hid_send_reports(void);
+
+/**
+ * @brief HID task
+ *
+ * This function submits the reports that changed while their interface was
+ * busy. It should be called in the main loop.
+ *
+ * @return None
+ */
+void hid_task(void);
@@ -189,6 +189,16 @@ typedef enum {
   SP_MOUSE_BUTTON_4 = 0x9E,
   SP_MOUSE_BUTTON_5 = 0x9F,
 
+  // Mouse movement keycodes. The speed follows the key travel distance.
+  SP_MOUSE_MOVE_LEFT = 0xA0,
+  SP_MOUSE_MOVE_RIGHT = 0xA1,
+  SP_MOUSE_MOVE_UP = 0xA2,
+  SP_MOUSE_MOVE_DOWN = 0xA3,
+  SP_MOUSE_WHEEL_DOWN = 0xA4,
+  SP_MOUSE_WHEEL_UP = 0xA5,
+  SP_MOUSE_WHEEL_LEFT = 0xA6,
+  SP_MOUSE_WHEEL_RIGHT = 0xA7,
+
   // Layer keycodes
   SP_MO_MIN = 0xC0,
   SP_MO_MAX = 0xC7,
@@ -204,6 +214,10 @@ typedef enum {
   SP_PROFILE_NEXT = 0xD3,
   SP_BOOT = 0xD4,
 
+  // Macro keycodes
+  SP_MACRO_MIN = 0xE0,
+  SP_MACRO_MAX = 0xEF,
+
   XXXXXXX = KC_NO,
   _______ = KC_TRANSPARENT,
   KC_TRNS = KC_TRANSPARENT,
@@ -307,6 +321,14 @@ typedef enum {
   MS_BTN3 = SP_MOUSE_BUTTON_3,
   MS_BTN4 = SP_MOUSE_BUTTON_4,
   MS_BTN5 = SP_MOUSE_BUTTON_5,
+  MS_LEFT = SP_MOUSE_MOVE_LEFT,
+  MS_RGHT = SP_MOUSE_MOVE_RIGHT,
+  MS_UP = SP_MOUSE_MOVE_UP,
+  MS_DOWN = SP_MOUSE_MOVE_DOWN,
+  MS_WHLD = SP_MOUSE_WHEEL_DOWN,
+  MS_WHLU = SP_MOUSE_WHEEL_UP,
+  MS_WHLL = SP_MOUSE_WHEEL_LEFT,
+  MS_WHLR = SP_MOUSE_WHEEL_RIGHT,
   KY_LOCK = SP_KEY_LOCK,
   LY_LOCK = SP_LAYER_LOCK,
   PF_SWAP = SP_PROFILE_SWAP,
@@ -326,6 +348,9 @@ extern const uint16_t keycode_to_hid[];
 #define PF(profile) (SP_PF_MIN | (profile))
 #define PF_GET_PROFILE(kc) ((kc) & 0x07)
 
+#define MC(macro) (SP_MACRO_MIN | (macro))
+#define MC_GET_MACRO(kc) ((kc) & 0x0F)
+
 #define IS_KEYBOARD_KEYCODE(kc) (KC_A <= (kc) && (kc) <= KC_LANGUAGE_5)
 #define IS_MODIFIER_KEYCODE(kc) (KC_LEFT_CTRL <= (kc) && (kc) <= KC_RIGHT_GUI)
 #define IS_SYSTEM_KEYCODE(kc)                                                  \
@@ -343,6 +368,8 @@ extern const uint16_t keycode_to_hid[];
 #define SYSTEM_KEYCODE_RANGE KC_SYSTEM_POWER... KC_SYSTEM_WAKE
 #define CONSUMER_KEYCODE_RANGE KC_AUDIO_MUTE... KC_LAUNCHPAD
 #define MOUSE_KEYCODE_RANGE SP_MOUSE_BUTTON_1... SP_MOUSE_BUTTON_5
+#define MOUSE_MOVE_KEYCODE_RANGE SP_MOUSE_MOVE_LEFT... SP_MOUSE_WHEEL_RIGHT
 #define HID_KEYCODE_RANGE KC_A... SP_MOUSE_BUTTON_5
 #define MOMENTARY_LAYER_RANGE SP_MO_MIN... SP_MO_MAX
 #define PROFILE_RANGE SP_PF_MIN... SP_PF_MAX
+#define MACRO_RANGE SP_MACRO_MIN... SP_MACRO_MAX
@@ -0,0 +1,110 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Latency Histograms
+//--------------------------------------------------------------------+
+
+// Number of buckets in each latency histogram. Bucket 0 counts the latencies
+// below 1us, bucket `i` counts the latencies in [2^(i - 1), 2^i) us, and the
+// last bucket also counts every longer latency.
+#define LATENCY_NUM_BUCKETS 13
+
+typedef enum {
+  // From the end of the ADC frame used by the matrix scan to the submission of
+  // the first report with its changes
+  LATENCY_SAMPLE_TO_REPORT = 0,
+  // From the detection of a key press or release in the matrix scan to the
+  // submission of the first report with its changes
+  LATENCY_CROSSING_TO_REPORT,
+  // Time between the starts of two consecutive matrix scans
+  LATENCY_SCAN_PERIOD,
+  LATENCY_HISTOGRAM_COUNT,
+} latency_histogram_id_t;
+
+typedef struct __attribute__((packed)) {
+  // Shortest and longest latencies in microseconds
+  uint32_t min_us;
+  uint32_t max_us;
+  // Number of latencies in each bucket
+  uint32_t buckets[LATENCY_NUM_BUCKETS];
+} latency_histogram_t;
+
+//--------------------------------------------------------------------+
+// Latency API
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Initialize the latency module
+ *
+ * @return None
+ */
+void latency_init(void);
+
+/**
+ * @brief Record the start of a matrix scan
+ *
+ * This function should be called before the ADC values are read.
+ *
+ * @return None
+ */
+void latency_scan_begin(void);
+
+/**
+ * @brief Record a key press or release detected by the current matrix scan
+ *
+ * @return None
+ */
+void latency_crossing(void);
+
+/**
+ * @brief Record that the current matrix scan changed the HID reports
+ *
+ * The latencies are measured from the oldest scan with a key press or release
+ * whose changes have not been submitted yet.
+ *
+ * @return None
+ */
+void latency_report_changed(void);
+
+/**
+ * @brief Record the submission of a HID report
+ *
+ * @return None
+ */
+void latency_report_sent(void);
+
+/**
+ * @brief Get a latency histogram
+ *
+ * @param id Histogram ID
+ *
+ * @return Latency histogram, or NULL if the ID is invalid
+ */
+const latency_histogram_t *latency_histogram(uint8_t id);
+
+/**
+ * @brief Clear a latency histogram
+ *
+ * @param id Histogram ID
+ *
+ * @return None
+ */
+void latency_reset(uint8_t id);
@@ -17,6 +17,19 @@
 
 #include "common.h"
 
+//--------------------------------------------------------------------+
+// Key Event Buffer
+//--------------------------------------------------------------------+
+
+#if !defined(MAX_BUFFERED_KEY_EVENTS)
+// Maximum number of key events buffered while a permissive hold Tap-Hold key is
+// undecided
+#define MAX_BUFFERED_KEY_EVENTS 16
+#endif
+
+_Static_assert(M_IS_POWER_OF_TWO(MAX_BUFFERED_KEY_EVENTS),
+               "MAX_BUFFERED_KEY_EVENTS must be a power of two");
+
 //--------------------------------------------------------------------+
 // Layout API
 //--------------------------------------------------------------------+
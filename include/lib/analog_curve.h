@@ -0,0 +1,60 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Analog Curve
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Apply an analog curve to an analog value
+ *
+ * The curve is defined by 4 points, and the value is linearly interpolated
+ * between them. We assume that the X coordinates are strictly increasing.
+ *
+ * @param curve 4 points that define the analog curve
+ * @param value Analog value
+ * @param[out] is_key_end_deadzone Whether the analog value is in the key end
+ * deadzone
+ *
+ * @return Processed analog value
+ */
+static inline uint8_t apply_analog_curve(const uint8_t (*curve)[2],
+                                         uint8_t value,
+                                         bool *is_key_end_deadzone) {
+  *is_key_end_deadzone = (value > curve[3][0]);
+  if (*is_key_end_deadzone)
+    // Key end deadzone
+    return 255;
+
+  if (value <= curve[0][0])
+    // Key start deadzone
+    return 0;
+
+  // Find the segment in the curve where the value falls
+  uint8_t i = 0;
+  for (; i < 3; i++) {
+    if (curve[i + 1][0] >= value)
+      break;
+  }
+
+  const int16_t x1 = curve[i][0], y1 = curve[i][1];
+  const int16_t x2 = curve[i + 1][0], y2 = curve[i + 1][1];
+
+  return y1 + (y2 - y1) * (value - x1) / (x2 - x1);
+}
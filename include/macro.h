@@ -0,0 +1,92 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Macro Configuration
+//--------------------------------------------------------------------+
+
+#if !defined(MACRO_BUFFER_SIZE)
+// Size of the persistent macro buffer in bytes. All macros share this buffer.
+#define MACRO_BUFFER_SIZE 1024
+#endif
+
+_Static_assert(MACRO_BUFFER_SIZE <= 65535,
+               "MACRO_BUFFER_SIZE must be at most 65535");
+
+// Number of macros that can be bound to a key (`SP_MACRO_MIN` to
+// `SP_MACRO_MAX`)
+#define NUM_MACROS 16
+
+//--------------------------------------------------------------------+
+// Macro Bytecode
+//--------------------------------------------------------------------+
+
+// Macro opcodes. Macros are stored back-to-back in the macro buffer, each one
+// terminated by `MACRO_OP_END`. The n-th macro starts after the n-th
+// `MACRO_OP_END`, so an erased (zeroed) buffer contains only empty macros.
+typedef enum {
+  // End of the macro
+  MACRO_OP_END = 0,
+  // Press and release a keycode. Followed by 1 byte keycode.
+  MACRO_OP_TAP,
+  // Press a keycode. Followed by 1 byte keycode.
+  MACRO_OP_PRESS,
+  // Release a keycode. Followed by 1 byte keycode.
+  MACRO_OP_RELEASE,
+  // Wait before the next step. Followed by 2 bytes delay in milliseconds
+  // (little-endian).
+  MACRO_OP_DELAY,
+  MACRO_OP_COUNT,
+} macro_op_t;
+
+//--------------------------------------------------------------------+
+// Macro API
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Start playing a macro
+ *
+ * The request is ignored if another macro is already playing.
+ *
+ * @param key Key index that triggered the macro
+ * @param macro Macro index
+ *
+ * @return None
+ */
+void macro_play(uint8_t key, uint8_t macro);
+
+/**
+ * @brief Stop the current macro and release every key it is holding
+ *
+ * This function should be called before the macro buffer is modified.
+ *
+ * @return None
+ */
+void macro_stop(void);
+
+/**
+ * @brief Macro task
+ *
+ * This function executes at most one macro step per call, and only when the
+ * previous HID report has been consumed by the host, so each step lands in its
+ * own report without blocking the matrix scan.
+ *
+ * @return None
+ */
+void macro_task(void);
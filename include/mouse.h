@@ -0,0 +1,60 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Mouse API
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Initialize the mouse module
+ *
+ * @return None
+ */
+void mouse_init(void);
+
+/**
+ * @brief Register a mouse movement key
+ *
+ * @param key Key index whose travel distance controls the speed
+ * @param keycode Mouse movement keycode
+ *
+ * @return None
+ */
+void mouse_register(uint8_t key, uint8_t keycode);
+
+/**
+ * @brief Unregister a mouse movement key
+ *
+ * @param key Key index
+ * @param keycode Mouse movement keycode
+ *
+ * @return None
+ */
+void mouse_unregister(uint8_t key, uint8_t keycode);
+
+/**
+ * @brief Mouse task
+ *
+ * This function accumulates the cursor and wheel movement since the last call
+ * in fixed-point, and passes the whole pixels and notches to the HID module.
+ * It should be called on every matrix scan.
+ *
+ * @return None
+ */
+void mouse_task(void);
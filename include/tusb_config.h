@@ -29,9 +29,17 @@
 #define CFG_TUD_ENABLED 1
 #define CFG_TUD_ENDPOINT0_SIZE 64
 
+// Event queue size. With frame sync or phase lock, the start-of-frame events
+// arrive every 125us at high speed, so the queue must absorb them for a few
+// milliseconds while the main loop is blocked.
+#define CFG_TUD_TASK_QUEUE_SZ 64
+
 // Driver configuration
-// Keyboard, generic, and raw HID interfaces + optionally log HID interface
-#if defined(LOG_ENABLED)
+// Keyboard, generic, and raw HID interfaces + optionally log and analog HID
+// interfaces
+#if defined(LOG_ENABLED) && defined(ANALOG_HID_ENABLED)
+#define CFG_TUD_HID 5
+#elif defined(LOG_ENABLED) || defined(ANALOG_HID_ENABLED)
 #define CFG_TUD_HID 4
 #else
 #define CFG_TUD_HID 3
@@ -41,6 +49,19 @@
 // interface with multiple reports)
 #define CFG_TUD_HID_EP_BUFSIZE 64
 
+// Vendor interface carrying the commands in large frames
+#define CFG_TUD_VENDOR 1
+
+#if defined(BOARD_USB_HS)
+#define CFG_TUD_VENDOR_EPSIZE 512
+#else
+#define CFG_TUD_VENDOR_EPSIZE 64
+#endif
+
+// Large enough for a whole response frame of a command
+#define CFG_TUD_VENDOR_RX_BUFSIZE (2 * CFG_TUD_VENDOR_EPSIZE)
+#define CFG_TUD_VENDOR_TX_BUFSIZE (2 * CFG_TUD_VENDOR_EPSIZE)
+
 #if defined(BOARD_USB_FS)
 #define BOARD_TUD_RHPORT 0
 #elif defined(BOARD_USB_HS)
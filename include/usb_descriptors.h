@@ -58,6 +58,10 @@ enum {
 #if defined(LOG_ENABLED)
   USB_ITF_LOG,
 #endif
+#if defined(ANALOG_HID_ENABLED)
+  USB_ITF_ANALOG,
+#endif
+  USB_ITF_VENDOR,
   // We intentionally put the XInput interface last, so that if it is not
   // enabled, we can subtract its size from the total configuration length
   // without affecting the other interfaces.
@@ -73,6 +77,10 @@ enum {
 #if defined(LOG_ENABLED)
   EP_IN_ADDR_LOG,
 #endif
+#if defined(ANALOG_HID_ENABLED)
+  EP_IN_ADDR_ANALOG,
+#endif
+  EP_IN_ADDR_VENDOR,
   EP_IN_ADDR_XINPUT,
 };
 
@@ -82,6 +90,7 @@ enum {
 #if defined(LOG_ENABLED)
   EP_OUT_ADDR_LOG,
 #endif
+  EP_OUT_ADDR_VENDOR,
   EP_OUT_ADDR_XINPUT,
 };
 
@@ -153,3 +162,27 @@ _Static_assert(RAW_HID_EP_SIZE == CFG_TUD_HID_EP_BUFSIZE,
 // Vendor defined usage ID (PJRC Teensy compatible)
 #define LOG_USAGE 0x74
 #endif
+
+//--------------------------------------------------------------------+
+// Analog HID Report
+//--------------------------------------------------------------------+
+
+#if defined(ANALOG_HID_ENABLED)
+#define ANALOG_HID_EP_SIZE 64
+// Vendor defined usage page
+#define ANALOG_HID_USAGE_PAGE 0xFFAC
+// Vendor defined usage ID
+#define ANALOG_HID_USAGE 0xAC
+
+_Static_assert(ANALOG_HID_EP_SIZE <= CFG_TUD_HID_EP_BUFSIZE,
+               "Invalid analog HID report size");
+#endif
+
+//--------------------------------------------------------------------+
+// Vendor Interface
+//--------------------------------------------------------------------+
+
+// Bulk endpoint size for USB HS
+#define VENDOR_EP_SIZE_HS 512
+// Bulk endpoint size for USB FS
+#define VENDOR_EP_SIZE_FS 64
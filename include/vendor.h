@@ -0,0 +1,59 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "common.h"
+
+//--------------------------------------------------------------------+
+// Vendor Frame
+//--------------------------------------------------------------------+
+
+// Frame header. Every request and response on the vendor interface is a
+// header followed by `len` bytes of payload.
+//
+// The payload of a request is a command buffer, as sent over the raw HID
+// interface, and the payload of its response is the command output buffer.
+// Requests shorter than the command buffer are padded with zeros. Since the
+// frames are not limited by the endpoint size, `COMMAND_READ_CONFIG` and
+// `COMMAND_WRITE_CONFIG` can transfer the whole persistent configuration in a
+// single frame: the response of `COMMAND_READ_CONFIG` is the command ID
+// followed by `len` bytes of configuration, and the request of
+// `COMMAND_WRITE_CONFIG` is followed by `len` bytes of configuration.
+typedef struct __attribute__((packed)) {
+  uint16_t len;
+} vendor_frame_header_t;
+
+//--------------------------------------------------------------------+
+// Vendor API
+//--------------------------------------------------------------------+
+
+/**
+ * @brief Initialize the vendor module
+ *
+ * @return None
+ */
+void vendor_init(void);
+
+/**
+ * @brief Vendor task
+ *
+ * This function receives the request frames from the vendor interface, and
+ * sends their responses.
+ *
+ * @return None
+ */
+void vendor_task(void);
@@ -113,3 +113,17 @@ bool wear_leveling_read(uint32_t addr, void *buf, uint32_t len);
  * @return true if the write was successful, false otherwise
  */
 bool wear_leveling_write(uint32_t addr, const void *buf, uint32_t len);
+
+/**
+ * @brief Callback invoked when the virtual storage is modified
+ *
+ * A default empty implementation is provided but can be overridden. It is
+ * invoked once the cache has been updated, and only for the bytes that
+ * changed.
+ *
+ * @param addr Address of the modified data
+ * @param len Length of the modified data in bytes
+ *
+ * @return None
+ */
+void wear_leveling_write_cb(uint32_t addr, uint32_t len);
@@ -15,19 +15,129 @@
 
 #include "advanced_keys.h"
 
+#include "bitmap.h"
 #include "deferred_actions.h"
 #include "eeconfig.h"
 #include "hardware/hardware.h"
+#include "hid.h"
 #include "keycodes.h"
 #include "layout.h"
 #include "matrix.h"
 
-static advanced_key_state_t ak_states[NUM_ADVANCED_KEYS];
+//--------------------------------------------------------------------+
+// Advanced Key State Pools
+//--------------------------------------------------------------------+
+
+// Marks an advanced key without a slot in its state pool
+#define AK_SLOT_NONE 0xFF
+
+// Backing storage of the state pools
+static uint32_t ak_state_pool[M_DIV_CEIL(AK_STATE_POOL_SIZE, 4)];
+
+static ak_state_null_bind_t *null_bind_states;
+static ak_state_dynamic_keystroke_t *dynamic_keystroke_states;
+static ak_state_tap_hold_t *tap_hold_states;
+static ak_state_toggle_t *toggle_states;
+static ak_state_socd_group_t *socd_group_states;
+static ak_state_turbo_t *turbo_states;
+
+// Size of the state of each advanced key type
+static const uint8_t ak_state_sizes[AK_TYPE_COUNT] = {
+    [AK_TYPE_NULL_BIND] = sizeof(ak_state_null_bind_t),
+    [AK_TYPE_DYNAMIC_KEYSTROKE] = sizeof(ak_state_dynamic_keystroke_t),
+    [AK_TYPE_TAP_HOLD] = sizeof(ak_state_tap_hold_t),
+    [AK_TYPE_TOGGLE] = sizeof(ak_state_toggle_t),
+    [AK_TYPE_SOCD_GROUP] = sizeof(ak_state_socd_group_t),
+    [AK_TYPE_TURBO] = sizeof(ak_state_turbo_t),
+};
+// Number of occupied slots in the state pool of each advanced key type
+static uint8_t pool_sizes[AK_TYPE_COUNT];
+// Index of the first slot of each pool in `pool_keys`
+static uint8_t pool_starts[AK_TYPE_COUNT];
+// Advanced key index of each occupied slot, grouped by type
+static uint8_t pool_keys[NUM_ADVANCED_KEYS];
+// Slot of each advanced key in the state pool of its type
+static uint8_t ak_slots[NUM_ADVANCED_KEYS];
+
+//--------------------------------------------------------------------+
+// Advanced Key Timers
+//--------------------------------------------------------------------+
+
+// Advanced keys with an armed timer
+static bitmap_t armed_timers[] = MAKE_BITMAP(NUM_ADVANCED_KEYS);
+static uint32_t num_armed_timers;
+// Deadline of each armed timer in milliseconds
+static uint32_t timer_deadlines[NUM_ADVANCED_KEYS];
+// Earliest deadline among the armed timers. It may be earlier than the actual
+// earliest deadline if that timer has been disarmed, in which case it is
+// recomputed once it is reached.
+static uint32_t next_deadline;
+
+// Tap-Hold keys in the tap stage with hold on other key press enabled
+static bitmap_t hold_on_other_keys[] = MAKE_BITMAP(NUM_ADVANCED_KEYS);
+static uint32_t num_hold_on_other_keys;
+
+__attribute__((always_inline)) static inline bool
+advanced_key_deadline_reached(uint32_t deadline) {
+  // Wrap-around safe comparison
+  return (int32_t)(timer_read() - deadline) >= 0;
+}
+
+static void advanced_key_timer_arm(uint8_t ak_index, uint32_t deadline) {
+  if (!bitmap_get(armed_timers, ak_index)) {
+    bitmap_set(armed_timers, ak_index, true);
+    num_armed_timers++;
+  }
+  timer_deadlines[ak_index] = deadline;
+
+  if (num_armed_timers == 1 || (int32_t)(deadline - next_deadline) < 0)
+    next_deadline = deadline;
+}
+
+static void advanced_key_timer_disarm(uint8_t ak_index) {
+  if (bitmap_get(armed_timers, ak_index)) {
+    bitmap_set(armed_timers, ak_index, false);
+    num_armed_timers--;
+  }
+}
+
+static void advanced_key_hold_on_other_set(uint8_t ak_index, bool armed) {
+  if (bitmap_get(hold_on_other_keys, ak_index) != armed) {
+    bitmap_set(hold_on_other_keys, ak_index, armed);
+    if (armed)
+      num_hold_on_other_keys++;
+    else
+      num_hold_on_other_keys--;
+  }
+}
+
+// Tap-Hold keys in the tap stage with permissive hold enabled
+static bitmap_t permissive_hold_keys[] = MAKE_BITMAP(NUM_ADVANCED_KEYS);
+static uint32_t num_permissive_hold_keys;
+
+static void advanced_key_permissive_hold_set(uint8_t ak_index, bool armed) {
+  if (bitmap_get(permissive_hold_keys, ak_index) != armed) {
+    bitmap_set(permissive_hold_keys, ak_index, armed);
+    if (armed)
+      num_permissive_hold_keys++;
+    else
+      num_permissive_hold_keys--;
+  }
+}
+
+static void advanced_key_timer_reset(void) {
+  memset(armed_timers, 0, sizeof(armed_timers));
+  num_armed_timers = 0;
+  memset(hold_on_other_keys, 0, sizeof(hold_on_other_keys));
+  num_hold_on_other_keys = 0;
+  memset(permissive_hold_keys, 0, sizeof(permissive_hold_keys));
+  num_permissive_hold_keys = 0;
+}
 
 static void advanced_key_null_bind(const advanced_key_event_t *event) {
   const null_bind_t *null_bind =
       &CURRENT_PROFILE.advanced_keys[event->ak_index].null_bind;
-  ak_state_null_bind_t *state = &ak_states[event->ak_index].null_bind;
+  ak_state_null_bind_t *state = &null_bind_states[ak_slots[event->ak_index]];
 
   const uint8_t keys[] = {
       CURRENT_PROFILE.advanced_keys[event->ak_index].key,
@@ -110,7 +220,7 @@ static void advanced_key_dynamic_keystroke(const advanced_key_event_t *event) {
   const dynamic_keystroke_t *dks =
       &CURRENT_PROFILE.advanced_keys[event->ak_index].dynamic_keystroke;
   ak_state_dynamic_keystroke_t *state =
-      &ak_states[event->ak_index].dynamic_keystroke;
+      &dynamic_keystroke_states[ak_slots[event->ak_index]];
 
   const bool is_bottomed_out =
       (key_matrix[event->key].distance >= dks->bottom_out_point);
@@ -140,14 +250,47 @@ static void advanced_key_dynamic_keystroke(const advanced_key_event_t *event) {
     if (keycode == KC_NO || action == DKS_ACTION_HOLD)
       continue;
 
-    if (state->is_pressed[i]) {
+    const bool was_pressed = state->is_pressed[i];
+    if (was_pressed) {
       // All actions except for `DKS_ACTION_HOLD` require the key to be
       // unregistered first if it was registered.
       layout_unregister(event->key, keycode);
       state->is_pressed[i] = false;
     }
 
-    if ((action == DKS_ACTION_PRESS) | (action == DKS_ACTION_TAP)) {
+    if ((action != DKS_ACTION_PRESS) & (action != DKS_ACTION_TAP))
+      continue;
+
+    bool is_sequenced =
+        IS_KEYBOARD_KEYCODE(keycode) || IS_MODIFIER_KEYCODE(keycode);
+    if (is_sequenced & was_pressed)
+      // The release needs its own report before the key is pressed again
+      is_sequenced = hid_report_barrier();
+
+    if (is_sequenced) {
+      // Keyboard keycodes are sequenced into consecutive reports within this
+      // matrix scan, so the action reaches the host on the next poll.
+      layout_register(event->key, keycode);
+      if (action == DKS_ACTION_PRESS) {
+        state->is_pressed[i] = true;
+        continue;
+      }
+
+      const bool is_closed = hid_report_barrier();
+      if (is_closed)
+        layout_unregister(event->key, keycode);
+      else {
+        // Fall back to releasing the key in the next matrix scan
+        deferred_action = (deferred_action_t){
+            .type = DEFERRED_ACTION_TYPE_RELEASE,
+            .key = event->key,
+            .keycode = keycode,
+        };
+        if (!deferred_action_push(&deferred_action))
+          // Release the key now rather than leaving it stuck
+          layout_unregister(event->key, keycode);
+      }
+    } else {
       // The report may have been modified in the previous step so we defer
       // the actual DKS action to the next matrix scan.
       deferred_action = (deferred_action_t){
@@ -162,33 +305,343 @@ static void advanced_key_dynamic_keystroke(const advanced_key_event_t *event) {
   }
 }
 
-static void advanced_key_tap_hold(const advanced_key_event_t *event) {
+/**
+ * @brief Get the key index of a key in a SOCD group
+ *
+ * @param ak Advanced key configuration
+ * @param pos Key position in the group
+ *
+ * @return Key index
+ */
+__attribute__((always_inline)) static inline uint8_t
+advanced_key_socd_group_key(const advanced_key_t *ak, uint32_t pos) {
+  return pos == 0 ? ak->key : ak->socd_group.keys[pos - 1];
+}
+
+static void advanced_key_socd_group(const advanced_key_event_t *event) {
+  const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[event->ak_index];
+  const socd_group_t *socd_group = &ak->socd_group;
+  ak_state_socd_group_t *state =
+      &socd_group_states[ak_slots[event->ak_index]];
+
+  uint32_t index = 0;
+  while (index < SOCD_GROUP_MAX_KEYS &&
+         advanced_key_socd_group_key(ak, index) != event->key)
+    index++;
+  if (index == SOCD_GROUP_MAX_KEYS)
+    return;
+
+  // Update the active keycodes and the press order
+  switch (event->type) {
+  case AK_EVENT_TYPE_PRESS:
+    state->keycodes[index] = event->keycode;
+    state->order = (state->order << 4) | index;
+    state->num_pressed++;
+    break;
+
+  case AK_EVENT_TYPE_RELEASE: {
+    if (state->registered & (1 << index)) {
+      // Also release the key if it is registered
+      layout_unregister(event->key, state->keycodes[index]);
+      state->registered &= ~(1 << index);
+    }
+    state->keycodes[index] = KC_NO;
+
+    // Remove the key from the press order
+    uint32_t shift = 0;
+    while (shift < state->num_pressed * 4 &&
+           ((state->order >> shift) & 0xF) != index)
+      shift += 4;
+    if (shift < state->num_pressed * 4) {
+      const uint32_t low = state->order & ((1u << shift) - 1u);
+      state->order = ((uint64_t)state->order >> (shift + 4) << shift) | low;
+      state->num_pressed--;
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  uint32_t pressed = 0, bottomed_out = 0;
+  for (uint32_t i = 0; i < state->num_pressed; i++) {
+    const uint32_t pos = (state->order >> (i * 4)) & 0xF;
+    const uint8_t distance =
+        key_matrix[advanced_key_socd_group_key(ak, pos)].distance;
+
+    pressed |= 1 << pos;
+    if ((socd_group->bottom_out_point > 0) &
+        (distance >= socd_group->bottom_out_point))
+      bottomed_out |= 1 << pos;
+  }
+
+  uint32_t target = 0;
+  if (state->num_pressed <= 1)
+    target = pressed;
+  else if (bottomed_out & (bottomed_out - 1))
+    // Input on bottom out is enabled and at least two keys are bottomed out so
+    // we register all the bottomed out keys.
+    target = bottomed_out;
+  else {
+    switch (socd_group->behavior) {
+    case SOCD_BEHAVIOR_LAST:
+      target = 1 << (state->order & 0xF);
+      break;
+
+    case SOCD_BEHAVIOR_FIRST:
+      target = 1 << ((state->order >> ((state->num_pressed - 1) * 4)) & 0xF);
+      break;
+
+    case SOCD_BEHAVIOR_DISTANCE: {
+      // If there is a tie between the travel distances, the last pressed key
+      // is prioritized.
+      uint8_t max_distance = 0;
+      for (uint32_t i = 0; i < state->num_pressed; i++) {
+        const uint32_t pos = (state->order >> (i * 4)) & 0xF;
+        const uint8_t distance =
+            key_matrix[advanced_key_socd_group_key(ak, pos)].distance;
+        if (i == 0 || distance > max_distance) {
+          max_distance = distance;
+          target = 1 << pos;
+        }
+      }
+      break;
+    }
+
+    default:
+      // `SOCD_BEHAVIOR_NEUTRAL`
+      break;
+    }
+  }
+
+  // Update the key states. The only changes here are the results of the SOCD
+  // resolution.
+  for (uint32_t changed = target ^ state->registered; changed;
+       changed &= changed - 1) {
+    const uint32_t pos = (uint32_t)__builtin_ctz(changed);
+    const uint8_t key = advanced_key_socd_group_key(ak, pos);
+
+    if (target & (1 << pos))
+      layout_register(key, state->keycodes[pos]);
+    else
+      layout_unregister(key, state->keycodes[pos]);
+  }
+  state->registered = target;
+}
+
+static void advanced_key_turbo(const advanced_key_event_t *event) {
+  const turbo_t *turbo = &CURRENT_PROFILE.advanced_keys[event->ak_index].turbo;
+  ak_state_turbo_t *state = &turbo_states[ak_slots[event->ak_index]];
+
+  const uint32_t duty_cycle =
+      (1 <= turbo->duty_cycle && turbo->duty_cycle <= 99) ? turbo->duty_cycle
+                                                          : 50;
+  const uint32_t press_us = (uint64_t)turbo->period_us * duty_cycle / 100;
+  const uint32_t release_us = turbo->period_us - press_us;
+  const uint32_t now = timer_read_us();
+
+  switch (event->type) {
+  case AK_EVENT_TYPE_PRESS:
+    layout_register(event->key, turbo->keycode);
+    // Close the report so that the edge is not merged with the other keycode
+    // changes of this matrix scan
+    hid_report_barrier();
+    state->is_pressed = true;
+    state->next_edge = now + press_us;
+    break;
+
+  case AK_EVENT_TYPE_HOLD:
+    // At most one edge per matrix scan, so that each edge lands in its own
+    // report.
+    if ((int32_t)(now - state->next_edge) < 0)
+      break;
+
+    if (state->is_pressed)
+      layout_unregister(event->key, turbo->keycode);
+    else
+      layout_register(event->key, turbo->keycode);
+    hid_report_barrier();
+    state->is_pressed = !state->is_pressed;
+
+    // Schedule from the previous edge so that the rate does not drift with
+    // the matrix scan rate, unless we are more than a period late.
+    if ((int32_t)(now - state->next_edge) >= (int32_t)turbo->period_us)
+      state->next_edge = now;
+    state->next_edge += state->is_pressed ? press_us : release_us;
+    break;
+
+  case AK_EVENT_TYPE_RELEASE:
+    if (state->is_pressed) {
+      layout_unregister(event->key, turbo->keycode);
+      hid_report_barrier();
+    }
+    state->is_pressed = false;
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Resolve a Tap-Hold key in the tap stage to the hold action
+ *
+ * @param ak_index Advanced key index
+ *
+ * @return None
+ */
+static void advanced_key_tap_hold_resolve_hold(uint8_t ak_index) {
+  const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[ak_index];
+  ak_state_tap_hold_t *state = &tap_hold_states[ak_slots[ak_index]];
+
+  layout_register(ak->key, ak->tap_hold.hold_keycode);
+  state->stage = TAP_HOLD_STAGE_HOLD;
+  advanced_key_timer_disarm(ak_index);
+  advanced_key_hold_on_other_set(ak_index, false);
+  advanced_key_permissive_hold_set(ak_index, false);
+}
+
+/**
+ * @brief Get the deadline of a Tap-Hold key in the tap stage
+ *
+ * @param tap_hold Tap-Hold configuration
+ * @param state Tap-Hold state
+ *
+ * @return Time when the key resolves to the hold action
+ */
+static uint32_t
+advanced_key_tap_hold_deadline(const tap_hold_t *tap_hold,
+                               const ak_state_tap_hold_t *state) {
+  uint32_t deadline = state->since + tap_hold->tapping_term;
+
+  if (state->is_deep &&
+      (int32_t)(state->deep_since + tap_hold->hold_dwell - deadline) < 0)
+    deadline = state->deep_since + tap_hold->hold_dwell;
+
+  return deadline;
+}
+
+/**
+ * @brief Perform the tap action of a Tap-Hold key
+ *
+ * @param key Key index
+ * @param tap_hold Tap-Hold configuration
+ *
+ * @return None
+ */
+static void advanced_key_tap_hold_tap(uint8_t key, const tap_hold_t *tap_hold) {
   static deferred_action_t deferred_action = {0};
 
+  deferred_action = (deferred_action_t){
+      .type = DEFERRED_ACTION_TYPE_RELEASE,
+      .key = key,
+      .keycode = tap_hold->tap_keycode,
+  };
+  if (deferred_action_push(&deferred_action)) {
+    // We only perform the tap action if the release action was
+    // successfully.
+    layout_register(key, tap_hold->tap_keycode);
+    // Close the press into its own report so that the release cannot be
+    // merged with it before the host polls
+    hid_report_barrier();
+  }
+}
+
+/**
+ * @brief Track whether a Tap-Hold key in the tap stage is past its hold point
+ *
+ * @param ak_index Advanced key index
+ * @param distance Key travel distance
+ *
+ * @return None
+ */
+static void advanced_key_tap_hold_update_depth(uint8_t ak_index,
+                                               uint8_t distance) {
+  const tap_hold_t *tap_hold =
+      &CURRENT_PROFILE.advanced_keys[ak_index].tap_hold;
+  ak_state_tap_hold_t *state = &tap_hold_states[ak_slots[ak_index]];
+
+  if (tap_hold->hold_point == 0)
+    return;
+
+  if (distance < tap_hold->hold_point)
+    state->is_deep = false;
+  else if (!state->is_deep) {
+    state->deep_since = timer_read();
+    state->is_deep = true;
+    if (tap_hold->hold_dwell == 0)
+      // Commit to the hold action as soon as the hold point is reached
+      advanced_key_tap_hold_resolve_hold(ak_index);
+    else
+      advanced_key_timer_arm(ak_index,
+                             advanced_key_tap_hold_deadline(tap_hold, state));
+  }
+}
+
+static void advanced_key_tap_hold(const advanced_key_event_t *event) {
   const tap_hold_t *tap_hold =
       &CURRENT_PROFILE.advanced_keys[event->ak_index].tap_hold;
-  ak_state_tap_hold_t *state = &ak_states[event->ak_index].tap_hold;
+  ak_state_tap_hold_t *state = &tap_hold_states[ak_slots[event->ak_index]];
 
   switch (event->type) {
   case AK_EVENT_TYPE_PRESS:
     state->since = timer_read();
     state->stage = TAP_HOLD_STAGE_TAP;
+    state->is_deep = false;
+    state->last_sample = state->since;
+    state->last_distance = key_matrix[event->key].distance;
+    advanced_key_timer_arm(event->ak_index,
+                           advanced_key_tap_hold_deadline(tap_hold, state));
+    advanced_key_hold_on_other_set(event->ak_index,
+                                   tap_hold->hold_on_other_key_press);
+    // Hold on other key press already resolves before the other key is
+    // released, so permissive hold has no effect in that case.
+    advanced_key_permissive_hold_set(event->ak_index,
+                                     tap_hold->permissive_hold &
+                                         !tap_hold->hold_on_other_key_press);
+    // The key may already be past the hold point when it is pressed, and it
+    // may not move again before the tapping term.
+    advanced_key_tap_hold_update_depth(event->ak_index, state->last_distance);
+    break;
+
+  case AK_EVENT_TYPE_HOLD: {
+    if (state->stage != TAP_HOLD_STAGE_TAP)
+      break;
+
+    const uint8_t distance = key_matrix[event->key].distance;
+    const uint32_t elapsed = timer_elapsed(state->last_sample);
+
+    if (tap_hold->tap_release_velocity && elapsed > 0) {
+      // Sample the key travel velocity every millisecond
+      if (state->last_distance > distance &&
+          (uint32_t)(state->last_distance - distance) >=
+              (uint32_t)(tap_hold->tap_release_velocity * elapsed)) {
+        // The key is released fast enough to commit to the tap action
+        advanced_key_tap_hold_tap(event->key, tap_hold);
+        state->stage = TAP_HOLD_STAGE_RELEASED;
+        advanced_key_timer_disarm(event->ak_index);
+        advanced_key_hold_on_other_set(event->ak_index, false);
+        advanced_key_permissive_hold_set(event->ak_index, false);
+        break;
+      }
+      state->last_sample += elapsed;
+      state->last_distance = distance;
+    }
+
+    advanced_key_tap_hold_update_depth(event->ak_index, distance);
     break;
+  }
 
   case AK_EVENT_TYPE_RELEASE:
-    if (state->stage == TAP_HOLD_STAGE_TAP) {
-      deferred_action = (deferred_action_t){
-          .type = DEFERRED_ACTION_TYPE_RELEASE,
-          .key = event->key,
-          .keycode = tap_hold->tap_keycode,
-      };
-      if (deferred_action_push(&deferred_action))
-        // We only perform the tap action if the release action was
-        // successfully.
-        layout_register(event->key, tap_hold->tap_keycode);
-    } else if (state->stage == TAP_HOLD_STAGE_HOLD)
+    if (state->stage == TAP_HOLD_STAGE_TAP)
+      advanced_key_tap_hold_tap(event->key, tap_hold);
+    else if (state->stage == TAP_HOLD_STAGE_HOLD)
       layout_unregister(event->key, tap_hold->hold_keycode);
     state->stage = TAP_HOLD_STAGE_NONE;
+    advanced_key_timer_disarm(event->ak_index);
+    advanced_key_hold_on_other_set(event->ak_index, false);
+    advanced_key_permissive_hold_set(event->ak_index, false);
     break;
 
   default:
@@ -199,7 +652,7 @@ static void advanced_key_tap_hold(const advanced_key_event_t *event) {
 static void advanced_key_toggle(const advanced_key_event_t *event) {
   const toggle_t *toggle =
       &CURRENT_PROFILE.advanced_keys[event->ak_index].toggle;
-  ak_state_toggle_t *state = &ak_states[event->ak_index].toggle;
+  ak_state_toggle_t *state = &toggle_states[ak_slots[event->ak_index]];
 
   switch (event->type) {
   case AK_EVENT_TYPE_PRESS:
@@ -208,6 +661,8 @@ static void advanced_key_toggle(const advanced_key_event_t *event) {
     if (state->is_toggled) {
       state->since = timer_read();
       state->stage = TOGGLE_STAGE_TOGGLE;
+      advanced_key_timer_arm(event->ak_index,
+                             state->since + toggle->tapping_term);
     } else
       // If the key is toggled off, we use the normal key behavior.
       state->stage = TOGGLE_STAGE_NORMAL;
@@ -217,6 +672,7 @@ static void advanced_key_toggle(const advanced_key_event_t *event) {
     if (!state->is_toggled)
       layout_unregister(event->key, toggle->keycode);
     state->stage = TOGGLE_STAGE_NONE;
+    advanced_key_timer_disarm(event->ak_index);
     break;
 
   default:
@@ -224,35 +680,166 @@ static void advanced_key_toggle(const advanced_key_event_t *event) {
   }
 }
 
-void advanced_key_init(void) {}
+void advanced_key_init(void) {
+  // No advanced key has a slot until the state pools are loaded
+  memset(ak_slots, AK_SLOT_NONE, sizeof(ak_slots));
+}
 
-void advanced_key_clear(void) {
-  // Release any keys that are currently pressed
+void advanced_key_load(void) {
+  uint8_t counts[AK_TYPE_COUNT] = {0};
   for (uint32_t i = 0; i < NUM_ADVANCED_KEYS; i++) {
-    const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[i];
-    const advanced_key_state_t *state = &ak_states[i];
+    const uint8_t type = CURRENT_PROFILE.advanced_keys[i].type;
+    if (type < AK_TYPE_COUNT)
+      counts[type]++;
+  }
 
-    switch (ak->type) {
-    case AK_TYPE_TAP_HOLD:
-      if (state->tap_hold.stage == TAP_HOLD_STAGE_HOLD)
-        layout_unregister(ak->key, ak->tap_hold.hold_keycode);
-      break;
+  // Carve the pools out of the backing storage, 4-byte aligned
+  void *pools[AK_TYPE_COUNT] = {0};
+  uint32_t offset = 0, start = 0;
+  for (uint32_t type = 0; type < AK_TYPE_COUNT; type++) {
+    const uint32_t size = ak_state_sizes[type];
+    if (size == 0) {
+      // The type has no pool, so its keys must not get a slot
+      counts[type] = 0;
+      continue;
+    }
 
-    case AK_TYPE_TOGGLE:
-      if (state->toggle.stage != TOGGLE_STAGE_NONE || state->toggle.is_toggled)
-        layout_unregister(ak->key, ak->toggle.keycode);
-      break;
+    const uint32_t capacity =
+        M_MIN(counts[type], (AK_STATE_POOL_SIZE - offset) / size);
+    pools[type] = (uint8_t *)ak_state_pool + offset;
+    offset = M_MIN((offset + capacity * size + 3) & ~3u, AK_STATE_POOL_SIZE);
+    pool_starts[type] = start;
+    start += capacity;
+    // Reuse `counts` as the capacity of each pool
+    counts[type] = capacity;
+  }
+  null_bind_states = pools[AK_TYPE_NULL_BIND];
+  dynamic_keystroke_states = pools[AK_TYPE_DYNAMIC_KEYSTROKE];
+  tap_hold_states = pools[AK_TYPE_TAP_HOLD];
+  toggle_states = pools[AK_TYPE_TOGGLE];
+  socd_group_states = pools[AK_TYPE_SOCD_GROUP];
+  turbo_states = pools[AK_TYPE_TURBO];
+  memset(ak_state_pool, 0, sizeof(ak_state_pool));
+
+  memset(pool_sizes, 0, sizeof(pool_sizes));
+  for (uint32_t i = 0; i < NUM_ADVANCED_KEYS; i++) {
+    const uint8_t type = CURRENT_PROFILE.advanced_keys[i].type;
 
-    default:
-      break;
+    ak_slots[i] = AK_SLOT_NONE;
+    if (type >= AK_TYPE_COUNT || pool_sizes[type] >= counts[type])
+      // No state is needed, or the pool is full
+      continue;
+
+    ak_slots[i] = pool_sizes[type]++;
+    pool_keys[pool_starts[type] + ak_slots[i]] = i;
+  }
+}
+
+/**
+ * @brief Get the advanced key that owns a pool slot
+ *
+ * @param type Advanced key type of the pool
+ * @param slot Slot index in the pool
+ *
+ * @return Advanced key, or NULL if the slot does not hold an advanced key of
+ * the pool type
+ */
+static const advanced_key_t *advanced_key_pool_key(uint8_t type,
+                                                   uint32_t slot) {
+  const advanced_key_t *ak =
+      &CURRENT_PROFILE.advanced_keys[pool_keys[pool_starts[type] + slot]];
+
+  return ak->type == type ? ak : NULL;
+}
+
+void advanced_key_clear(void) {
+  const advanced_key_t *ak;
+
+  // Release any keys that are currently pressed. Only the pools of the types
+  // that may hold keys need to be visited.
+  for (uint32_t i = 0; i < pool_sizes[AK_TYPE_TAP_HOLD]; i++) {
+    ak = advanced_key_pool_key(AK_TYPE_TAP_HOLD, i);
+    if (ak && tap_hold_states[i].stage == TAP_HOLD_STAGE_HOLD)
+      layout_unregister(ak->key, ak->tap_hold.hold_keycode);
+  }
+
+  for (uint32_t i = 0; i < pool_sizes[AK_TYPE_TOGGLE]; i++) {
+    const ak_state_toggle_t *state = &toggle_states[i];
+
+    ak = advanced_key_pool_key(AK_TYPE_TOGGLE, i);
+    if (ak && (state->stage != TOGGLE_STAGE_NONE || state->is_toggled))
+      layout_unregister(ak->key, ak->toggle.keycode);
+  }
+
+  for (uint32_t i = 0; i < pool_sizes[AK_TYPE_SOCD_GROUP]; i++) {
+    const ak_state_socd_group_t *state = &socd_group_states[i];
+
+    ak = advanced_key_pool_key(AK_TYPE_SOCD_GROUP, i);
+    if (!ak)
+      continue;
+
+    for (uint32_t registered = state->registered; registered;
+         registered &= registered - 1) {
+      const uint32_t pos = (uint32_t)__builtin_ctz(registered);
+      layout_unregister(advanced_key_socd_group_key(ak, pos),
+                        state->keycodes[pos]);
     }
   }
+
+  for (uint32_t i = 0; i < pool_sizes[AK_TYPE_TURBO]; i++) {
+    ak = advanced_key_pool_key(AK_TYPE_TURBO, i);
+    if (ak && turbo_states[i].is_pressed)
+      layout_unregister(ak->key, ak->turbo.keycode);
+  }
+
   // Clear the advanced key states
-  memset(ak_states, 0, sizeof(ak_states));
+  memset(ak_state_pool, 0, sizeof(ak_state_pool));
+  advanced_key_timer_reset();
+}
+
+uint8_t advanced_key_hold_subscription(const advanced_key_t *ak) {
+  switch (ak->type) {
+  case AK_TYPE_NULL_BIND:
+    // Only the distance behavior and the bottom-out point compare the travel
+    // distances while the keys are held.
+    return (ak->null_bind.behavior == NB_BEHAVIOR_DISTANCE) |
+                   (ak->null_bind.bottom_out_point > 0)
+               ? AK_HOLD_SUBSCRIPTION_ON_CHANGE
+               : AK_HOLD_SUBSCRIPTION_NONE;
+
+  case AK_TYPE_DYNAMIC_KEYSTROKE:
+    // Track the bottom-out point
+    return AK_HOLD_SUBSCRIPTION_ON_CHANGE;
+
+  case AK_TYPE_TAP_HOLD:
+    // The tap release velocity is sampled every millisecond, including while
+    // the key is still, so that a sample never spans the idle time. The hold
+    // point follows the travel distance. The tapping term and the hold dwell
+    // time are driven by timers.
+    if (ak->tap_hold.tap_release_velocity > 0)
+      return AK_HOLD_SUBSCRIPTION_EVERY_SCAN;
+    return ak->tap_hold.hold_point > 0 ? AK_HOLD_SUBSCRIPTION_ON_CHANGE
+                                       : AK_HOLD_SUBSCRIPTION_NONE;
+
+  case AK_TYPE_SOCD_GROUP:
+    return (ak->socd_group.behavior == SOCD_BEHAVIOR_DISTANCE) |
+                   (ak->socd_group.bottom_out_point > 0)
+               ? AK_HOLD_SUBSCRIPTION_ON_CHANGE
+               : AK_HOLD_SUBSCRIPTION_NONE;
+
+  case AK_TYPE_TURBO:
+    // The press and release edges are scheduled in time
+    return AK_HOLD_SUBSCRIPTION_EVERY_SCAN;
+
+  default:
+    return AK_HOLD_SUBSCRIPTION_NONE;
+  }
 }
 
 void advanced_key_process(const advanced_key_event_t *event) {
-  if (event->ak_index >= NUM_ADVANCED_KEYS)
+  if (event->ak_index >= NUM_ADVANCED_KEYS ||
+      ak_slots[event->ak_index] == AK_SLOT_NONE)
+    // Invalid advanced key, or the state pool of its type is full
     return;
 
   switch (CURRENT_PROFILE.advanced_keys[event->ak_index].type) {
@@ -272,42 +859,123 @@ void advanced_key_process(const advanced_key_event_t *event) {
     advanced_key_toggle(event);
     break;
 
+  case AK_TYPE_SOCD_GROUP:
+    advanced_key_socd_group(event);
+    break;
+
+  case AK_TYPE_TURBO:
+    advanced_key_turbo(event);
+    break;
+
   default:
     break;
   }
 }
 
-void advanced_key_tick(bool has_non_tap_hold_press) {
-  for (uint32_t i = 0; i < NUM_ADVANCED_KEYS; i++) {
-    const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[i];
-    advanced_key_state_t *state = &ak_states[i];
-
-    switch (ak->type) {
-    case AK_TYPE_TAP_HOLD:
-      if (state->tap_hold.stage == TAP_HOLD_STAGE_TAP &&
-          // If hold on other key press is enabled, immediately register the
-          // hold key when another non-Tap-Hold key is pressed.
-          ((has_non_tap_hold_press & ak->tap_hold.hold_on_other_key_press) ||
-           // Otherwise, the key must be held for the tapping term.
-           timer_elapsed(state->tap_hold.since) >= ak->tap_hold.tapping_term)) {
-        layout_register(ak->key, ak->tap_hold.hold_keycode);
-        state->tap_hold.stage = TAP_HOLD_STAGE_HOLD;
-      }
-      break;
+bool advanced_key_has_permissive_hold(void) {
+  return num_permissive_hold_keys > 0;
+}
 
-    case AK_TYPE_TOGGLE:
-      if (state->toggle.stage == TOGGLE_STAGE_TOGGLE &&
-          timer_elapsed(state->toggle.since) >= ak->toggle.tapping_term) {
-        // If the key is held for more than the tapping term, switch to the
-        // normal key behavior.
-        state->toggle.stage = TOGGLE_STAGE_NORMAL;
-        // Always toggle the key off when in normal behavior
-        state->toggle.is_toggled = false;
-      }
-      break;
+bool advanced_key_is_permissive_hold(uint8_t ak_index) {
+  return bitmap_get(permissive_hold_keys, ak_index);
+}
 
-    default:
+void advanced_key_permissive_hold(void) {
+  for (uint32_t w = 0; w < M_ARRAY_SIZE(permissive_hold_keys); w++) {
+    for (uint32_t bits = permissive_hold_keys[w]; bits; bits &= bits - 1)
+      advanced_key_tap_hold_resolve_hold(w * 32 +
+                                         (uint32_t)__builtin_ctz(bits));
+  }
+}
+
+bool advanced_key_timer_expired(void) {
+  return num_armed_timers > 0 && advanced_key_deadline_reached(next_deadline);
+}
+
+/**
+ * @brief Handle an expired advanced key timer
+ *
+ * @param ak_index Advanced key index
+ *
+ * @return None
+ */
+static void advanced_key_timer_expire(uint8_t ak_index) {
+  const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[ak_index];
+
+  advanced_key_timer_disarm(ak_index);
+  switch (ak->type) {
+  case AK_TYPE_TAP_HOLD: {
+    const ak_state_tap_hold_t *state = &tap_hold_states[ak_slots[ak_index]];
+
+    if (state->stage != TAP_HOLD_STAGE_TAP)
       break;
+
+    const uint32_t deadline =
+        advanced_key_tap_hold_deadline(&ak->tap_hold, state);
+    if (advanced_key_deadline_reached(deadline))
+      // The key is held for the tapping term, or past the hold point for the
+      // hold dwell time.
+      advanced_key_tap_hold_resolve_hold(ak_index);
+    else
+      // The key left the hold point before the hold dwell time
+      advanced_key_timer_arm(ak_index, deadline);
+    break;
+  }
+
+  case AK_TYPE_TOGGLE: {
+    ak_state_toggle_t *state = &toggle_states[ak_slots[ak_index]];
+
+    if (state->stage == TOGGLE_STAGE_TOGGLE) {
+      // If the key is held for more than the tapping term, switch to the
+      // normal key behavior.
+      state->stage = TOGGLE_STAGE_NORMAL;
+      // Always toggle the key off when in normal behavior
+      state->is_toggled = false;
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void advanced_key_tick(bool has_non_tap_hold_press) {
+  if (has_non_tap_hold_press & (num_hold_on_other_keys > 0)) {
+    // Immediately register the hold key of the Tap-Hold keys with hold on
+    // other key press enabled.
+    for (uint32_t w = 0; w < M_ARRAY_SIZE(hold_on_other_keys); w++) {
+      for (uint32_t bits = hold_on_other_keys[w]; bits; bits &= bits - 1)
+        advanced_key_tap_hold_resolve_hold(w * 32 +
+                                           (uint32_t)__builtin_ctz(bits));
+    }
+  }
+
+  if (!advanced_key_timer_expired())
+    return;
+
+  // Fire the expired timers
+  for (uint32_t w = 0; w < M_ARRAY_SIZE(armed_timers); w++) {
+    for (uint32_t bits = armed_timers[w]; bits; bits &= bits - 1) {
+      const uint8_t ak_index = w * 32 + (uint32_t)__builtin_ctz(bits);
+
+      if (advanced_key_deadline_reached(timer_deadlines[ak_index]))
+        advanced_key_timer_expire(ak_index);
+    }
+  }
+
+  // Recompute the earliest deadline in a second pass since an expired timer
+  // may arm a timer again with a new deadline
+  bool has_next_deadline = false;
+  for (uint32_t w = 0; w < M_ARRAY_SIZE(armed_timers); w++) {
+    for (uint32_t bits = armed_timers[w]; bits; bits &= bits - 1) {
+      const uint8_t ak_index = w * 32 + (uint32_t)__builtin_ctz(bits);
+      const uint32_t deadline = timer_deadlines[ak_index];
+
+      if (!has_next_deadline || (int32_t)(deadline - next_deadline) < 0) {
+        next_deadline = deadline;
+        has_next_deadline = true;
+      }
     }
   }
 }
@@ -0,0 +1,98 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "analog_hid.h"
+
+#if defined(ANALOG_HID_ENABLED)
+#include "bitmap.h"
+#include "matrix.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+_Static_assert(sizeof(analog_hid_report_t) <= ANALOG_HID_EP_SIZE,
+               "Invalid analog HID report size");
+_Static_assert(NUM_KEYS <= 256, "Key index must fit in an analog HID entry");
+
+static analog_hid_report_t report;
+// Keys streamed to the host
+static bitmap_t streamed_keys[] = MAKE_BITMAP(NUM_KEYS);
+// Last distance of each key sent to the host
+static uint8_t sent_distances[NUM_KEYS];
+// Next key to check for changes, so that every key gets its turn when more
+// keys change than fit in a report
+static uint32_t change_cursor;
+// Next key to send when there is room left in the report
+static uint32_t refresh_cursor;
+
+/**
+ * @brief Add a key to the report
+ *
+ * @param key Key index
+ *
+ * @return None
+ */
+static void analog_hid_add(uint8_t key) {
+  const uint8_t distance = key_matrix[key].distance;
+
+  report.entries[report.num_entries].key = key;
+  report.entries[report.num_entries].distance = distance;
+  report.num_entries++;
+  sent_distances[key] = distance;
+}
+
+void analog_hid_init(void) {
+  for (uint32_t i = 0; i < NUM_KEYS; i++)
+    bitmap_set(streamed_keys, i, true);
+}
+
+void analog_hid_set_keys(const uint8_t *buf, uint32_t len) {
+  for (uint32_t i = 0; i < NUM_KEYS; i++)
+    bitmap_set(streamed_keys, i, i / 8 < len && ((buf[i / 8] >> (i & 7)) & 1));
+}
+
+void analog_hid_task(void) {
+  if (!tud_hid_n_ready(USB_ITF_ANALOG))
+    return;
+
+  memset(&report, 0, sizeof(report));
+
+  // Send the changed keys first
+  for (uint32_t i = 0;
+       i < NUM_KEYS && report.num_entries < ANALOG_HID_MAX_ENTRIES; i++) {
+    const uint32_t key = (change_cursor + i) % NUM_KEYS;
+
+    if (!bitmap_get(streamed_keys, key) ||
+        key_matrix[key].distance == sent_distances[key])
+      continue;
+
+    analog_hid_add(key);
+    change_cursor = (key + 1) % NUM_KEYS;
+  }
+
+  // Fill the rest of the report with the other keys in turn
+  for (uint32_t i = 0;
+       i < NUM_KEYS && report.num_entries < ANALOG_HID_MAX_ENTRIES; i++) {
+    const uint32_t key = refresh_cursor;
+
+    refresh_cursor = (refresh_cursor + 1) % NUM_KEYS;
+    if (bitmap_get(streamed_keys, key))
+      analog_hid_add(key);
+  }
+
+  if (report.num_entries > 0)
+    tud_hid_n_report(USB_ITF_ANALOG, 0, &report, sizeof(report));
+}
+#endif
@@ -16,8 +16,10 @@
 #include "commands.h"
 
 #include "advanced_keys.h"
+#include "bitmap.h"
 #include "hardware/hardware.h"
 #include "layout.h"
+#include "macro.h"
 #include "matrix.h"
 #include "metadata.h"
 #include "tusb.h"
@@ -29,15 +31,212 @@
     break;                                                                     \
   }
 
-static uint8_t out_buf[RAW_HID_EP_SIZE];
+static uint8_t raw_hid_out_buf[RAW_HID_EP_SIZE];
+
+// Command buffers received from the raw HID interface waiting to be executed
+static uint8_t command_queue[MAX_QUEUED_COMMANDS][RAW_HID_EP_SIZE];
+static uint32_t command_queue_head;
+static uint32_t command_queue_size;
+// Number of commands rejected because the queue was full, waiting for their
+// `COMMAND_UNKNOWN` responses
+static uint32_t num_rejected_commands;
+// Whether the device must be enumerated again once the last response is sent
+static bool should_reenumerate;
+
+// Number of chunks that fit in the write session buffer
+#define WRITE_SESSION_MAX_CHUNKS                                               \
+  M_DIV_CEIL(WRITE_SESSION_BUFFER_SIZE, WRITE_SESSION_CHUNK_SIZE)
+
+_Static_assert(WRITE_SESSION_MAX_CHUNKS <= 65536,
+               "WRITE_SESSION_BUFFER_SIZE is too large");
+
+static bool is_session_active;
+static uint16_t session_offset;
+static uint16_t session_len;
+// Sequence number of the first chunk not received yet
+static uint32_t session_next_sequence;
+static bitmap_t session_received[] = MAKE_BITMAP(WRITE_SESSION_MAX_CHUNKS);
+static uint8_t session_buffer[WRITE_SESSION_BUFFER_SIZE];
+
+// Time when the last command was executed
+static uint32_t last_command_time;
+
+static bool is_streaming;
+static uint16_t stream_interval_us;
+static uint16_t stream_adc_threshold;
+// Whether the current stream frame still has keys to check
+static bool is_stream_frame_active;
+static uint8_t stream_frame_number;
+// Time when the current stream frame started, in microseconds
+static uint32_t stream_frame_time;
+// Next key to check in the current stream frame
+static uint32_t stream_cursor;
+// Last ADC value and distance sent for each key
+static command_out_analog_info_t stream_values[NUM_KEYS];
+// Whether the key has not been sent since the stream started
+static bitmap_t stream_unsent[] = MAKE_BITMAP(NUM_KEYS);
+
+/**
+ * @brief Check whether options differ from the current options in a way that
+ * changes the configuration descriptor
+ *
+ * @param options Options to compare with the current options
+ *
+ * @return true if the device must be enumerated again, false otherwise
+ */
+static bool command_usb_options_changed(const eeconfig_options_t *options) {
+  const eeconfig_options_t *current = &eeconfig->options;
+
+  return options->xinput_enabled != current->xinput_enabled ||
+         options->keyboard_polling_rate != current->keyboard_polling_rate ||
+         options->hid_polling_rate != current->hid_polling_rate ||
+         options->raw_hid_polling_rate != current->raw_hid_polling_rate ||
+         options->xinput_polling_rate != current->xinput_polling_rate;
+}
+
+/**
+ * @brief Fill the write session state of a response
+ *
+ * @param o Output write session state
+ *
+ * @return None
+ */
+static void command_write_session_state(command_out_write_session_t *o) {
+  o->next_sequence = session_next_sequence;
+  o->window = MAX_QUEUED_COMMANDS;
+}
+
+/**
+ * @brief Push the next report of the analog stream
+ *
+ * Each report carries the keys that changed since they were last sent, checked
+ * from where the previous report of the frame stopped, so the cost per call is
+ * bounded by the number of keys.
+ *
+ * @return None
+ */
+static void command_stream_analog(void) {
+  command_out_buffer_t *out = (command_out_buffer_t *)raw_hid_out_buf;
+  command_out_analog_frame_t *o = &out->analog_frame;
+
+  if (!is_streaming)
+    return;
+
+  if (timer_elapsed(last_command_time) >= ANALOG_STREAM_TIMEOUT_MS) {
+    // The host is gone
+    is_streaming = false;
+    return;
+  }
+
+  if (!is_stream_frame_active) {
+    const uint32_t now = timer_read_us();
+
+    if (now - stream_frame_time < stream_interval_us)
+      return;
+    stream_frame_time = now;
+    stream_frame_number++;
+    stream_cursor = 0;
+    is_stream_frame_active = true;
+  }
+
+  out->command_id = COMMAND_ANALOG_FRAME;
+  o->frame_number = stream_frame_number;
+  o->num_entries = 0;
+  while (stream_cursor < NUM_KEYS &&
+         o->num_entries < M_ARRAY_SIZE(o->entries)) {
+    const uint8_t key = stream_cursor++;
+    const uint16_t adc_value = key_matrix[key].adc_filtered;
+    const uint8_t distance = key_matrix[key].distance;
+    command_out_analog_info_t *prev = &stream_values[key];
+
+    if (!bitmap_get(stream_unsent, key) && distance == prev->distance &&
+        M_MAX(adc_value, prev->adc_value) - M_MIN(adc_value, prev->adc_value) <=
+            stream_adc_threshold)
+      continue;
+
+    bitmap_set(stream_unsent, key, false);
+    prev->adc_value = adc_value;
+    prev->distance = distance;
+    o->entries[o->num_entries].key = key;
+    o->entries[o->num_entries].analog_info = *prev;
+    o->num_entries++;
+  }
+  is_stream_frame_active = stream_cursor < NUM_KEYS;
+
+  if (o->num_entries > 0)
+    tud_hid_n_report(USB_ITF_RAW_HID, 0, raw_hid_out_buf, RAW_HID_EP_SIZE);
+}
 
 void command_init(void) {}
 
-void command_process(const uint8_t *buf) {
-  const command_in_buffer_t *in = (const command_in_buffer_t *)buf;
+/**
+ * @brief Check whether raw data can be written to the persistent configuration
+ *
+ * The magic numbers and the version must not change, and the profile indices
+ * must be valid.
+ *
+ * @param offset Offset in the persistent configuration
+ * @param buf Data to write
+ * @param len Length of the data in bytes
+ *
+ * @return true if the data is valid, false otherwise
+ */
+static bool command_config_is_valid(uint32_t offset, const uint8_t *buf,
+                                    uint32_t len) {
+  const uint8_t *config = (const uint8_t *)eeconfig;
+
+  for (uint32_t i = 0; i < len; i++) {
+    const uint32_t addr = offset + i;
+
+    if ((addr < offsetof(eeconfig_t, calibration) ||
+         addr >= offsetof(eeconfig_t, magic_end)) &&
+        buf[i] != config[addr])
+      return false;
+    if ((addr == offsetof(eeconfig_t, current_profile) ||
+         addr == offsetof(eeconfig_t, last_non_default_profile)) &&
+        buf[i] >= NUM_PROFILES)
+      return false;
+  }
+
+  return true;
+}
+
+bool command_write_config(uint32_t offset, const void *buf, uint32_t len,
+                          bool *should_reenumerate) {
+  *should_reenumerate = false;
+  if (offset > sizeof(eeconfig_t) || len > sizeof(eeconfig_t) - offset ||
+      !command_config_is_valid(offset, buf, len))
+    return false;
+
+  // The options may be modified as well
+  const eeconfig_options_t options = eeconfig->options;
+
+  // The macros and the advanced keys may be modified
+  macro_stop();
+  advanced_key_clear();
+  const bool success = wear_leveling_write(offset, buf, len);
+  layout_load_advanced_keys();
+  *should_reenumerate = success && command_usb_options_changed(&options);
+
+  return success;
+}
+
+void command_reenumerate(void) {
+  // The configuration descriptor is rebuilt from the new options when the
+  // host enumerates the device again
+  tud_disconnect();
+  timer_delay(10);
+  tud_connect();
+}
+
+bool command_execute(const uint8_t *in_buf, uint8_t *out_buf) {
+  const command_in_buffer_t *in = (const command_in_buffer_t *)in_buf;
   command_out_buffer_t *out = (command_out_buffer_t *)out_buf;
 
   bool success = true;
+  bool should_reenumerate = false;
+  // Any command keeps the analog stream alive
+  last_command_time = timer_read();
   switch (in->command_id) {
   case COMMAND_FIRMWARE_VERSION: {
     out->firmware_version = FIRMWARE_VERSION;
@@ -52,6 +251,7 @@ void command_process(const uint8_t *buf) {
     break;
   }
   case COMMAND_FACTORY_RESET: {
+    macro_stop();
     advanced_key_clear();
     success = eeconfig_reset();
     layout_load_advanced_keys();
@@ -91,6 +291,7 @@ void command_process(const uint8_t *buf) {
     break;
   }
   case COMMAND_SET_OPTIONS: {
+    should_reenumerate = command_usb_options_changed(&in->options);
     success = EECONFIG_WRITE(options, &in->options);
     break;
   }
@@ -143,6 +344,127 @@ void command_process(const uint8_t *buf) {
            M_MIN(sizeof(out->metadata.metadata), out->metadata.len));
     break;
   }
+  case COMMAND_GET_MACROS: {
+    const command_in_macros_t *p = &in->macros;
+
+    COMMAND_VERIFY(p->offset < MACRO_BUFFER_SIZE);
+
+    memcpy(out->macros, eeconfig->macros + p->offset,
+           M_MIN(M_ARRAY_SIZE(out->macros),
+                 (uint32_t)(MACRO_BUFFER_SIZE - p->offset)) *
+               sizeof(uint8_t));
+    break;
+  }
+  case COMMAND_SET_MACROS: {
+    const command_in_macros_t *p = &in->macros;
+
+    COMMAND_VERIFY(p->offset < MACRO_BUFFER_SIZE);
+    COMMAND_VERIFY(p->len <= M_ARRAY_SIZE(p->macros) &&
+                   p->len <= MACRO_BUFFER_SIZE - p->offset);
+
+    // The macro being played may be modified
+    macro_stop();
+    success = EECONFIG_WRITE_N(macros[p->offset], p->macros,
+                               sizeof(uint8_t) * p->len);
+    break;
+  }
+  case COMMAND_READ_CONFIG: {
+    const command_in_config_t *p = &in->config;
+
+    COMMAND_VERIFY(p->offset < sizeof(eeconfig_t));
+
+    memcpy(out->config, (const uint8_t *)eeconfig + p->offset,
+           M_MIN(M_MIN(M_ARRAY_SIZE(out->config), p->len),
+                 sizeof(eeconfig_t) - p->offset));
+    break;
+  }
+  case COMMAND_WRITE_CONFIG: {
+    const command_in_config_t *p = &in->config;
+
+    COMMAND_VERIFY(p->len <= M_ARRAY_SIZE(p->data));
+
+    success = command_write_config(p->offset, p->data, p->len,
+                                   &should_reenumerate);
+    break;
+  }
+  case COMMAND_GET_LATENCY: {
+    const command_in_latency_t *p = &in->latency;
+    const latency_histogram_t *histogram = latency_histogram(p->histogram);
+
+    COMMAND_VERIFY(histogram != NULL);
+
+    out->latency = *histogram;
+    if (p->reset)
+      latency_reset(p->histogram);
+    break;
+  }
+  case COMMAND_SUBSCRIBE_ANALOG: {
+    const command_in_analog_stream_t *p = &in->analog_stream;
+
+    if (!is_streaming)
+      // Start with every key
+      memset(stream_unsent, 0xFF, sizeof(stream_unsent));
+    is_streaming = p->interval_us > 0;
+    stream_interval_us = p->interval_us;
+    stream_adc_threshold = p->adc_threshold;
+    break;
+  }
+  case COMMAND_WRITE_SESSION_BEGIN: {
+    const command_in_write_session_t *p = &in->write_session;
+
+    COMMAND_VERIFY(p->len <= WRITE_SESSION_BUFFER_SIZE);
+    COMMAND_VERIFY(p->offset <= sizeof(eeconfig_t) &&
+                   p->len <= sizeof(eeconfig_t) - p->offset);
+
+    is_session_active = true;
+    session_offset = p->offset;
+    session_len = p->len;
+    session_next_sequence = 0;
+    memset(session_received, 0, sizeof(session_received));
+    command_write_session_state(&out->write_session);
+    break;
+  }
+  case COMMAND_WRITE_SESSION_DATA: {
+    const command_in_write_session_data_t *p = &in->write_session_data;
+    const uint32_t pos = (uint32_t)p->sequence * WRITE_SESSION_CHUNK_SIZE;
+
+    COMMAND_VERIFY(is_session_active && pos < session_len);
+
+    // Chunks received again are written again, with the same data
+    memcpy(session_buffer + pos, p->data,
+           M_MIN(WRITE_SESSION_CHUNK_SIZE, session_len - pos));
+    bitmap_set(session_received, p->sequence, true);
+    while (session_next_sequence * WRITE_SESSION_CHUNK_SIZE < session_len &&
+           bitmap_get(session_received, session_next_sequence))
+      session_next_sequence++;
+    command_write_session_state(&out->write_session);
+    break;
+  }
+  case COMMAND_WRITE_SESSION_COMMIT: {
+    COMMAND_VERIFY(is_session_active &&
+                   session_next_sequence * WRITE_SESSION_CHUNK_SIZE >=
+                       session_len);
+
+    // The whole session is written in a single write
+    is_session_active = false;
+    success = command_write_config(session_offset, session_buffer, session_len,
+                                   &should_reenumerate);
+    command_write_session_state(&out->write_session);
+    break;
+  }
+  case COMMAND_GET_DIGEST: {
+    const command_in_digest_t *p = &in->digest;
+    command_out_digest_t *o = &out->digest;
+
+    COMMAND_VERIFY(p->offset < EECONFIG_NUM_SECTIONS);
+
+    o->num_sections = EECONFIG_NUM_SECTIONS;
+    for (uint32_t i = 0; i < M_ARRAY_SIZE(o->digests) &&
+                         i + p->offset < EECONFIG_NUM_SECTIONS;
+         i++)
+      o->digests[i] = eeconfig_digest(i + p->offset);
+    break;
+  }
   case COMMAND_SET_KEYMAP: {
     const command_in_keymap_t *p = &in->keymap;
 
@@ -269,6 +591,23 @@ void command_process(const uint8_t *buf) {
                              &p->gamepad_options);
     break;
   }
+  case COMMAND_GET_MOUSE_OPTIONS: {
+    const command_in_mouse_options_t *p = &in->mouse_options;
+
+    COMMAND_VERIFY(p->profile < NUM_PROFILES);
+
+    out->mouse_options = eeconfig->profiles[p->profile].mouse_options;
+    break;
+  }
+  case COMMAND_SET_MOUSE_OPTIONS: {
+    const command_in_mouse_options_t *p = &in->mouse_options;
+
+    COMMAND_VERIFY(p->profile < NUM_PROFILES);
+
+    success = EECONFIG_WRITE(profiles[p->profile].mouse_options,
+                             &p->mouse_options);
+    break;
+  }
   default: {
     // Unknown command
     success = false;
@@ -279,8 +618,57 @@ void command_process(const uint8_t *buf) {
   // Echo the command ID back to the host if successful
   out->command_id = success ? in->command_id : COMMAND_UNKNOWN;
 
-  while (!tud_hid_n_ready(USB_ITF_RAW_HID))
-    // Wait for the raw HID interface to be ready
-    tud_task();
-  tud_hid_n_report(USB_ITF_RAW_HID, 0, out_buf, RAW_HID_EP_SIZE);
+  return should_reenumerate && success;
+}
+
+void command_process(const uint8_t *buf, uint32_t len) {
+  if (command_queue_size == MAX_QUEUED_COMMANDS || num_rejected_commands > 0) {
+    // The host sent more commands than the window allows. The command is
+    // rejected, and so are the following ones until the rejections are
+    // answered, so that the responses stay in order.
+    num_rejected_commands++;
+    return;
+  }
+
+  uint8_t *in_buf = command_queue[(command_queue_head + command_queue_size) &
+                                  (MAX_QUEUED_COMMANDS - 1)];
+  const uint32_t in_len = M_MIN(len, RAW_HID_EP_SIZE);
+
+  // Commands shorter than the command buffer are padded with zeros
+  memcpy(in_buf, buf, in_len);
+  memset(in_buf + in_len, 0, RAW_HID_EP_SIZE - in_len);
+  command_queue_size++;
+}
+
+void command_task(void) {
+  if (!tud_hid_n_ready(USB_ITF_RAW_HID))
+    // Wait for the previous response to be sent
+    return;
+
+  if (should_reenumerate) {
+    should_reenumerate = false;
+    command_reenumerate();
+    return;
+  }
+
+  if (command_queue_size == 0 && num_rejected_commands > 0) {
+    memset(raw_hid_out_buf, 0, sizeof(raw_hid_out_buf));
+    raw_hid_out_buf[0] = COMMAND_UNKNOWN;
+    num_rejected_commands--;
+    tud_hid_n_report(USB_ITF_RAW_HID, 0, raw_hid_out_buf, RAW_HID_EP_SIZE);
+    return;
+  }
+
+  if (command_queue_size == 0) {
+    // The analog stream only uses the raw HID interface when no command is
+    // waiting for its response
+    command_stream_analog();
+    return;
+  }
+
+  should_reenumerate =
+      command_execute(command_queue[command_queue_head], raw_hid_out_buf);
+  command_queue_head = (command_queue_head + 1) & (MAX_QUEUED_COMMANDS - 1);
+  command_queue_size--;
+  tud_hid_n_report(USB_ITF_RAW_HID, 0, raw_hid_out_buf, RAW_HID_EP_SIZE);
 }
@@ -13,21 +13,118 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #include "deferred_actions.h"
 
 #include "eeconfig.h"
+#include "hardware/hardware.h"
+#include "hid.h"
 #include "layout.h"
 
-// Lock for the deferred action queue
-static bool queue_lock;
+// Single-producer single-consumer ring of deferred actions. The indices are
+// free-running, and each one is only written by one side of the ring.
+typedef struct {
+  // Index of the next action to pop. Only written by the consumer.
+  volatile uint32_t head;
+  // Index of the next free slot. Only written by the producer.
+  volatile uint32_t tail;
+  // Capacity of the ring minus one. The capacity must be a power of two.
+  uint32_t mask;
+  deferred_action_t *actions;
+} deferred_action_ring_t;
+
+static deferred_action_t queue_actions[MAX_DEFERRED_ACTIONS];
+static deferred_action_t spill_actions[MAX_SPILLED_DEFERRED_ACTIONS];
+static deferred_action_t tap_release_actions[MAX_DEFERRED_ACTIONS];
+
+// Deferred action queue, filled by `deferred_action_push()`
+static deferred_action_ring_t queue = {
+    .mask = MAX_DEFERRED_ACTIONS - 1,
+    .actions = queue_actions,
+};
+// Release actions that did not fit in the deferred action queue
+static deferred_action_ring_t spill = {
+    .mask = MAX_SPILLED_DEFERRED_ACTIONS - 1,
+    .actions = spill_actions,
+};
+// Releases of the executed tap actions. Both sides of this ring are owned by
+// the consumer so that executing a tap never pushes to the producer side.
+static deferred_action_ring_t tap_releases = {
+    .mask = MAX_DEFERRED_ACTIONS - 1,
+    .actions = tap_release_actions,
+};
+
+static deferred_action_ring_t *const rings[] = {
+    &queue,
+    &spill,
+    &tap_releases,
+};
+
+static uint32_t overflow_count;
+// Whether the deadlines are in USB frames instead of microseconds. Only
+// updated by `deferred_action_process()`.
+static bool is_frame_synced;
+
+static bool ring_is_full(const deferred_action_ring_t *ring) {
+  return ring->tail - ring->head > ring->mask;
+}
+
+static bool ring_push(deferred_action_ring_t *ring,
+                      const deferred_action_t *action, uint32_t deadline) {
+  const uint32_t tail = ring->tail;
+
+  if (ring_is_full(ring))
+    return false;
+
+  deferred_action_t *slot = &ring->actions[tail & ring->mask];
+  *slot = *action;
+  slot->deadline = deadline;
+  // Publish the action only after it is fully written
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  ring->tail = tail + 1;
+
+  return true;
+}
 
-// Deferred action queue
-static uint32_t queue_head;
-static uint32_t queue_size;
-static deferred_action_t queue[MAX_DEFERRED_ACTIONS];
+static uint32_t deferred_action_now(void) {
+  return is_frame_synced ? hid_frame_count() : timer_read_us();
+}
+
+static uint32_t deferred_action_deadline(void) {
+  if (is_frame_synced)
+    // The press is sent in the current frame, and the next report can be
+    // sent from the next frame on
+    return hid_frame_count() + 1;
+
+  return timer_read_us() + CURRENT_PROFILE.tick_rate * DEFERRED_ACTION_TICK_US;
+}
+
+/**
+ * @brief Update the unit of the deadlines
+ *
+ * The pending actions are made ready when the unit changes, since their
+ * deadlines cannot be compared with the new unit. This happens when the option
+ * changes, or when the host stops polling the device.
+ *
+ * @return None
+ */
+static void deferred_action_update_timebase(void) {
+  const bool frame_synced =
+      eeconfig->options.frame_sync_enabled && hid_frame_count_active();
+
+  if (frame_synced == is_frame_synced)
+    return;
+
+  is_frame_synced = frame_synced;
+  const uint32_t now = deferred_action_now();
+  for (uint32_t i = 0; i < M_ARRAY_SIZE(rings); i++) {
+    for (uint32_t j = rings[i]->head; j != rings[i]->tail; j++)
+      rings[i]->actions[j & rings[i]->mask].deadline = now;
+  }
+}
 
 static void deferred_action_execute(const deferred_action_t *action) {
-  static deferred_action_t deferred_action = {0};
+  deferred_action_t release;
 
   switch (action->type) {
   case DEFERRED_ACTION_TYPE_PRESS:
@@ -39,15 +136,18 @@ static void deferred_action_execute(const deferred_action_t *action) {
     break;
 
   case DEFERRED_ACTION_TYPE_TAP:
-    deferred_action = (deferred_action_t){
+    release = (deferred_action_t){
         .type = DEFERRED_ACTION_TYPE_RELEASE,
         .key = action->key,
         .keycode = action->keycode,
     };
-    if (deferred_action_push(&deferred_action))
-      // We only perform the tap action if the release action was successfully
-      // enqueued. Otherwise, the key will be stuck in the pressed state.
-      layout_register(action->key, action->keycode);
+    // There is always room for the release since `deferred_action_process()`
+    // does not pop a tap action while `tap_releases` is full.
+    ring_push(&tap_releases, &release, deferred_action_deadline());
+    layout_register(action->key, action->keycode);
+    // Keep the press in its own report even if the release is due before the
+    // report is sent
+    hid_report_barrier();
     break;
 
   default:
@@ -58,53 +158,64 @@ static void deferred_action_execute(const deferred_action_t *action) {
 void deferred_action_init(void) {}
 
 bool deferred_action_push(const deferred_action_t *action) {
-  if (queue_lock || queue_size == MAX_DEFERRED_ACTIONS)
-    return false;
-
-  queue_lock = true;
+  const uint32_t deadline = deferred_action_deadline();
 
-  deferred_action_t *queue_tail =
-      &queue[(queue_head + queue_size) & (MAX_DEFERRED_ACTIONS - 1)];
-  queue_size++;
-  *queue_tail = *action;
-  queue_tail->ticks = CURRENT_PROFILE.tick_rate;
+  if (ring_push(&queue, action, deadline))
+    return true;
 
-  queue_lock = false;
-
-  return true;
+  overflow_count++;
+  // A lost release would leave the key stuck so it is moved to the spill queue
+  // instead. Other actions are rejected, and the caller backs off.
+  return action->type == DEFERRED_ACTION_TYPE_RELEASE &&
+         ring_push(&spill, action, deadline);
 }
 
-void deferred_action_process(void) {
-  static deferred_action_t buffer[MAX_DEFERRED_ACTIONS];
-
-  if (queue_lock || queue_size == 0)
-    return;
+uint32_t deferred_action_overflow_count(void) { return overflow_count; }
 
-  queue_lock = true;
-
-  // Copy actions in the queue to a buffer to avoid the queue being locked while
-  // executing those actions
-  uint32_t action_count = 0;
-  for (uint32_t i = 0; i < queue_size; i++) {
-    deferred_action_t *action =
-        &queue[(queue_head + i) & (MAX_DEFERRED_ACTIONS - 1)];
-
-    // Make sure the ticks are not greater than the tick rate
-    action->ticks = M_MIN(action->ticks, CURRENT_PROFILE.tick_rate);
-    if (action->ticks > 0) {
-      // Decrement the ticks and skip the action if it is not ready yet
-      action->ticks--;
-      continue;
+void deferred_action_process(void) {
+  deferred_action_update_timebase();
+
+  // Only process the actions pushed before this call so that the loop below is
+  // bounded even if the deferred delay is zero
+  uint32_t ends[M_ARRAY_SIZE(rings)];
+  for (uint32_t i = 0; i < M_ARRAY_SIZE(rings); i++)
+    ends[i] = rings[i]->tail;
+  // Make sure the actions are read after their indices
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  const uint32_t now = deferred_action_now();
+  while (true) {
+    // Pick the ready action with the earliest deadline across the rings so
+    // that the actions are executed in the order they were scheduled
+    deferred_action_ring_t *ring = NULL;
+    const deferred_action_t *action = NULL;
+    for (uint32_t i = 0; i < M_ARRAY_SIZE(rings); i++) {
+      if (rings[i]->head == ends[i])
+        continue;
+
+      const deferred_action_t *head =
+          &rings[i]->actions[rings[i]->head & rings[i]->mask];
+      if ((int32_t)(now - head->deadline) < 0)
+        // The action is not ready yet
+        continue;
+      if (head->type == DEFERRED_ACTION_TYPE_TAP && ring_is_full(&tap_releases))
+        // The tap must wait for a release slot, which does not hold back the
+        // ready actions of the other rings
+        continue;
+      if (action == NULL || (int32_t)(head->deadline - action->deadline) < 0) {
+        ring = rings[i];
+        action = head;
+      }
     }
-    buffer[action_count++] = *action;
-  }
-  // Move the head of the queue forward by the number of actions processed
-  queue_head = (queue_head + action_count) & (MAX_DEFERRED_ACTIONS - 1);
-  queue_size -= action_count;
 
-  queue_lock = false;
+    if (action == NULL)
+      // Nothing is ready
+      break;
 
-  // Execute all the actions
-  for (uint32_t i = 0; i < action_count; i++)
-    deferred_action_execute(&buffer[i]);
+    const deferred_action_t ready = *action;
+    // Release the slot only after the action is copied
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->head++;
+    deferred_action_execute(&ready);
+  }
 }
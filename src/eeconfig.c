@@ -15,6 +15,8 @@
 
 #include "eeconfig.h"
 
+#include "bitmap.h"
+#include "crc32.h"
 #include "keycodes.h"
 #include "migration.h"
 
@@ -27,8 +29,76 @@ static eeconfig_profile_t default_profile = {
     .keymap = DEFAULT_KEYMAP,
     .gamepad_options = DEFAULT_GAMEPAD_OPTIONS,
     .tick_rate = DEFAULT_TICK_RATE,
+    .mouse_options = DEFAULT_MOUSE_OPTIONS,
 };
 
+// Offset and length of a configuration section
+typedef struct {
+  uint16_t offset;
+  uint16_t len;
+} eeconfig_section_t;
+
+// Helper macro to define a section from consecutive fields
+#define EECONFIG_SECTION(type, first, last)                                    \
+  {                                                                            \
+      .offset = offsetof(type, first),                                         \
+      .len = offsetof(type, last) + sizeof(((type *)0)->last) -                \
+             offsetof(type, first),                                            \
+  }
+
+// Offsets are relative to the configuration
+static const eeconfig_section_t global_sections[] = {
+    [EECONFIG_SECTION_SETTINGS] = EECONFIG_SECTION(eeconfig_t, calibration,
+                                                   last_non_default_profile),
+    [EECONFIG_SECTION_MACROS] = EECONFIG_SECTION(eeconfig_t, macros, macros),
+};
+
+_Static_assert(M_ARRAY_SIZE(global_sections) == EECONFIG_NUM_GLOBAL_SECTIONS,
+               "Invalid number of global sections");
+
+// Offsets are relative to the profile
+static const eeconfig_section_t profile_sections[] = {
+    [EECONFIG_SECTION_KEYMAP] =
+        EECONFIG_SECTION(eeconfig_profile_t, keymap, keymap),
+    [EECONFIG_SECTION_ACTUATION_MAP] =
+        EECONFIG_SECTION(eeconfig_profile_t, actuation_map, actuation_map),
+    [EECONFIG_SECTION_ADVANCED_KEYS] =
+        EECONFIG_SECTION(eeconfig_profile_t, advanced_keys, advanced_keys),
+    [EECONFIG_SECTION_GAMEPAD_BUTTONS] =
+        EECONFIG_SECTION(eeconfig_profile_t, gamepad_buttons, gamepad_buttons),
+    [EECONFIG_SECTION_PROFILE_OPTIONS] =
+        EECONFIG_SECTION(eeconfig_profile_t, gamepad_options, mouse_options),
+};
+
+_Static_assert(M_ARRAY_SIZE(profile_sections) == EECONFIG_NUM_PROFILE_SECTIONS,
+               "Invalid number of profile sections");
+
+// Cached digest of each section, valid if its bit in `digest_valid` is set
+static uint32_t digests[EECONFIG_NUM_SECTIONS];
+static bitmap_t digest_valid[] = MAKE_BITMAP(EECONFIG_NUM_SECTIONS);
+
+/**
+ * @brief Get the range of a section in the configuration
+ *
+ * @param section Section index
+ *
+ * @return Offset and length of the section in the configuration
+ */
+static eeconfig_section_t eeconfig_section(uint32_t section) {
+  if (section < EECONFIG_NUM_GLOBAL_SECTIONS)
+    return global_sections[section];
+
+  section -= EECONFIG_NUM_GLOBAL_SECTIONS;
+  const uint32_t profile = section / EECONFIG_NUM_PROFILE_SECTIONS;
+  eeconfig_section_t range =
+      profile_sections[section % EECONFIG_NUM_PROFILE_SECTIONS];
+
+  range.offset += offsetof(eeconfig_t, profiles) +
+                  profile * sizeof(eeconfig_profile_t);
+
+  return range;
+}
+
 static bool eeconfig_is_latest_version(void) {
   return eeconfig->magic_start == EECONFIG_MAGIC_START &&
          eeconfig->magic_end == EECONFIG_MAGIC_END &&
@@ -62,6 +132,7 @@ bool eeconfig_reset(void) {
   status &= EECONFIG_WRITE(options, &default_options);
   EECONFIG_WRITE_LOCAL(current_profile, 0);
   EECONFIG_WRITE_LOCAL(last_non_default_profile, M_MIN(1, NUM_PROFILES - 1));
+  status &= eeconfig_reset_macros();
   for (uint32_t i = 0; i < NUM_PROFILES; i++)
     status &= EECONFIG_WRITE(profiles[i], &default_profile);
   EECONFIG_WRITE_LOCAL(magic_end, EECONFIG_MAGIC_END);
@@ -71,9 +142,52 @@ bool eeconfig_reset(void) {
 
 #undef EECONFIG_WRITE_LOCAL
 
+bool eeconfig_reset_macros(void) {
+  // Write the empty macros in chunks to avoid keeping a zeroed copy of the
+  // whole macro buffer in memory
+  static const uint8_t empty_macros[64] = {0};
+
+  bool status = true;
+  for (uint32_t i = 0; i < MACRO_BUFFER_SIZE; i += sizeof(empty_macros))
+    status &= EECONFIG_WRITE_N(
+        macros[i], empty_macros,
+        M_MIN(sizeof(empty_macros), (uint32_t)(MACRO_BUFFER_SIZE - i)));
+
+  return status;
+}
+
 bool eeconfig_reset_profile(uint8_t profile) {
   if (profile >= NUM_PROFILES)
     return false;
 
   return EECONFIG_WRITE(profiles[profile], &default_profile);
 }
+
+uint32_t eeconfig_digest(uint32_t section) {
+  if (section >= EECONFIG_NUM_SECTIONS)
+    return 0;
+
+  if (!bitmap_get(digest_valid, section)) {
+    const eeconfig_section_t range = eeconfig_section(section);
+
+    digests[section] =
+        crc32_compute((const uint8_t *)eeconfig + range.offset, range.len, 0);
+    bitmap_set(digest_valid, section, true);
+  }
+
+  return digests[section];
+}
+
+//--------------------------------------------------------------------+
+// Wear Leveling Callbacks
+//--------------------------------------------------------------------+
+
+void wear_leveling_write_cb(uint32_t addr, uint32_t len) {
+  // Invalidate the digests of the sections that overlap the written range
+  for (uint32_t i = 0; i < EECONFIG_NUM_SECTIONS; i++) {
+    const eeconfig_section_t range = eeconfig_section(i);
+
+    if (addr < range.offset + range.len && range.offset < addr + len)
+      bitmap_set(digest_valid, i, false);
+  }
+}
@@ -92,6 +92,8 @@ __attribute__((aligned(8))) static volatile uint16_t
     adc_buffer[ADC_NUM_MUX_INPUTS + ADC_NUM_RAW_INPUTS];
 // ADC values for each key
 static volatile uint16_t adc_values[NUM_KEYS];
+// Cycle count at the end of the last complete ADC frame
+static volatile uint32_t frame_time;
 
 void analog_init(void) {
   // Enable peripheral clocks
@@ -222,6 +224,8 @@ void analog_task(void) {}
 
 uint16_t analog_read(uint8_t key) { return adc_values[key]; }
 
+uint32_t analog_frame_time(void) { return frame_time; }
+
 //--------------------------------------------------------------------+
 // Interrupt Handlers
 //--------------------------------------------------------------------+
@@ -257,6 +261,8 @@ void DMA1_Channel1_IRQHandler(void) {
     // We initialize all the ADC values when we have gone through all the
     // multiplexer input channels.
     adc_initialized |= (current_mux_channel == 0);
+    if (current_mux_channel == 0)
+      frame_time = board_cycle_count();
 
     // Set the multiplexer select pins
     for (uint32_t i = 0; i < ADC_NUM_MUX_SELECT_PINS; i++)
@@ -268,6 +274,7 @@ void DMA1_Channel1_IRQHandler(void) {
 #else
     // We initialize all the ADC values when we have read all the raw input.
     adc_initialized = true;
+    frame_time = board_cycle_count();
     // Immediately start the next conversion
     adc_ordinary_software_trigger_enable(ADC1, TRUE);
 #endif
@@ -23,6 +23,18 @@ void timer_init(void) { SysTick_Config(system_core_clock / 1000); }
 
 uint32_t timer_read(void) { return counter; }
 
+uint32_t timer_read_us(void) {
+  uint32_t ms, val;
+
+  do {
+    // Read again if the counter is incremented in between
+    ms = counter;
+    val = SysTick->VAL;
+  } while (ms != counter);
+
+  return ms * 1000 + (SysTick->LOAD - val) * 1000 / (SysTick->LOAD + 1);
+}
+
 //--------------------------------------------------------------------+
 // Interrupt Handlers
 //--------------------------------------------------------------------+
@@ -94,6 +94,8 @@ __attribute__((aligned(8))) static volatile uint16_t
     adc_buffer[ADC_NUM_MUX_INPUTS + ADC_NUM_RAW_INPUTS];
 // ADC values for each key
 static volatile uint16_t adc_values[NUM_KEYS];
+// Cycle count at the end of the last complete ADC frame
+static volatile uint32_t frame_time;
 
 void analog_init(void) {
   ADC_ChannelConfTypeDef channel_config = {0};
@@ -221,6 +223,8 @@ void analog_task(void) {}
 
 uint16_t analog_read(uint8_t key) { return adc_values[key]; }
 
+uint32_t analog_frame_time(void) { return frame_time; }
+
 //--------------------------------------------------------------------+
 // Interrupt Handlers
 //--------------------------------------------------------------------+
@@ -261,6 +265,8 @@ void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) {
     // We initialize all the ADC values when we have gone through all the
     // multiplexer input channels.
     adc_initialized |= (current_mux_channel == 0);
+    if (current_mux_channel == 0)
+      frame_time = board_cycle_count();
 
     // Set the multiplexer select pins
     for (uint32_t i = 0; i < ADC_NUM_MUX_SELECT_PINS; i++)
@@ -272,6 +278,7 @@ void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) {
 #else
     // We initialize all the ADC values when we have read all the raw input.
     adc_initialized = true;
+    frame_time = board_cycle_count();
     // Immediately start the next conversion
     HAL_ADC_Start_DMA(&adc_handle, (uint32_t *)adc_buffer,
                       ADC_NUM_MUX_INPUTS + ADC_NUM_RAW_INPUTS);
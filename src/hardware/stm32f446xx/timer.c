@@ -20,3 +20,16 @@
 void timer_init(void) {}
 
 uint32_t timer_read(void) { return HAL_GetTick(); }
+
+uint32_t timer_read_us(void) {
+  uint32_t ms, val;
+
+  do {
+    // Read again if the tick is incremented in between
+    ms = HAL_GetTick();
+    val = SysTick->VAL;
+  } while (ms != HAL_GetTick());
+
+  // The HAL configures SysTick to interrupt every millisecond
+  return ms * 1000 + (SysTick->LOAD - val) * 1000 / (SysTick->LOAD + 1);
+}
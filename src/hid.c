@@ -15,84 +15,230 @@
 
 #include "hid.h"
 
+#include "analog_hid.h"
 #include "bitmap.h"
 #include "commands.h"
+#include "eeconfig.h"
+#include "hardware/hardware.h"
 #include "keycodes.h"
+#include "latency.h"
 #include "tusb.h"
 #include "usb_descriptors.h"
 
 // Track how many keys are currently in the 6KRO part of the report
 static uint8_t num_6kro_keys;
 static hid_nkro_kb_report_t kb_report;
+// Last keyboard report sent to the host
+static hid_nkro_kb_report_t prev_kb_report;
+
+// Keyboard reports closed by `hid_report_barrier()` waiting to be sent
+static hid_nkro_kb_report_t kb_report_queue[MAX_QUEUED_KEYBOARD_REPORTS];
+static uint32_t kb_report_queue_head;
+static uint32_t kb_report_queue_size;
 
 static uint16_t system_report;
 static uint16_t consumer_report;
 static hid_mouse_report_t mouse_report;
+// Last reports of the HID interface sent to the host
+static uint16_t prev_system_report;
+static uint16_t prev_consumer_report;
+static hid_mouse_report_t prev_mouse_report;
+// Bitmask of the report IDs of the HID interface that changed since they were
+// last sent
+static uint8_t pending_reports;
+// Mouse movement not sent yet (x, y, wheel, pan)
+static int32_t mouse_movement[4];
+
+// Whether the remote wakeup has been signaled during the current suspension
+static bool is_waking_up;
+// Time when the remote wakeup was last signaled
+static uint32_t wakeup_time;
+
+// Whether the start-of-frame callback is enabled
+static bool is_sof_enabled;
+// Number of USB start-of-frame events received
+static volatile uint32_t frame_count;
+// Estimated time of the last start-of-frame, in microseconds
+static uint32_t sof_time;
+
+/**
+ * @brief Get the nominal USB frame period
+ *
+ * @return Frame period in microseconds
+ */
+static uint32_t hid_frame_period_us(void) {
+  return tud_speed_get() == TUSB_SPEED_HIGH ? 125 : 1000;
+}
+
+#if !defined(HID_DISABLED)
+/**
+ * @brief Enable the start-of-frame callback only while it is used
+ *
+ * Only frame sync and phase lock use the USB frames. At high speed, the
+ * callback queues 8000 events per second in TinyUSB, which could fill the
+ * event queue while the main loop is blocked by a flash write.
+ *
+ * @return None
+ */
+static void hid_update_sof(void) {
+  const bool enabled = tud_mounted() && (eeconfig->options.frame_sync_enabled ||
+                                         eeconfig->options.phase_lock_enabled);
+
+  if (enabled == is_sof_enabled)
+    return;
+
+  tud_sof_cb_enable(enabled);
+  is_sof_enabled = enabled;
+}
+#endif
+
+/**
+ * @brief Check whether the reports can be submitted now
+ *
+ * With phase lock, the reports are only submitted in the last
+ * `HID_PHASE_LOCK_LEAD_US` of a frame so that the host reads the most recent
+ * state at the start of the next frame, instead of a report latched up to a
+ * frame earlier. Phase lock is not used if the frames are too short for it.
+ *
+ * @return true if the reports can be submitted, false otherwise
+ */
+static bool hid_in_submit_window(void) {
+  const uint32_t period = hid_frame_period_us();
+
+  if (!eeconfig->options.phase_lock_enabled || !hid_frame_count_active() ||
+      period <= 2 * HID_PHASE_LOCK_LEAD_US)
+    return true;
+
+  const uint32_t elapsed = timer_read_us() - sof_time;
+  // Submit anyway if the frame estimate is lost so reports are never stalled
+  return elapsed >= period - HID_PHASE_LOCK_LEAD_US || elapsed >= 2 * period;
+}
+
+/**
+ * @brief Move the pending mouse movement into the mouse report
+ *
+ * Each axis is clamped to the report range, and the rest is kept for the next
+ * report.
+ *
+ * @return true if the mouse report has movement, false otherwise
+ */
+static bool hid_take_mouse_movement(void) {
+  int8_t *axes[] = {
+      &mouse_report.x,
+      &mouse_report.y,
+      &mouse_report.wheel,
+      &mouse_report.pan,
+  };
+  bool has_movement = false;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    const int32_t value = M_MAX(-127, M_MIN(127, mouse_movement[i]));
+
+    *axes[i] = value;
+    mouse_movement[i] -= value;
+    has_movement |= (value != 0);
+  }
+
+  return has_movement;
+}
 
 /**
  * @brief Send the keyboard report
  *
- * This function will send the keyboard report to its exclusive interface.
+ * This function will send the oldest queued keyboard report, or the current
+ * keyboard report if the queue is empty, to its exclusive interface.
  *
  * @return None
  */
 static void hid_send_keyboard_report(void) {
-  static hid_nkro_kb_report_t prev_kb_report = {0};
+  const hid_nkro_kb_report_t *report = &kb_report;
+
+  if (!hid_in_submit_window())
+    return;
 
-  if (memcmp(&prev_kb_report, &kb_report, sizeof(prev_kb_report)) == 0)
+  if (kb_report_queue_size > 0) {
+    report = &kb_report_queue[kb_report_queue_head];
+    kb_report_queue_head =
+        (kb_report_queue_head + 1) & (MAX_QUEUED_KEYBOARD_REPORTS - 1);
+    kb_report_queue_size--;
+  }
+
+  if (memcmp(&prev_kb_report, report, sizeof(prev_kb_report)) == 0)
     // Don't send the report if it hasn't changed
     return;
 
-  prev_kb_report = kb_report;
-  tud_hid_n_report(USB_ITF_KEYBOARD, 0, &kb_report, sizeof(kb_report));
+  prev_kb_report = *report;
+  tud_hid_n_report(USB_ITF_KEYBOARD, 0, &prev_kb_report,
+                   sizeof(prev_kb_report));
+  latency_report_sent();
 }
 
 /**
- * @brief Find the next available report and send it
+ * @brief Send the next pending report of the HID interface
  *
- * @param starting_report_id The report ID to start searching from
+ * The reports share the endpoint of the HID interface, so each changed report
+ * takes one poll. The pending reports are served in round-robin order starting
+ * after the last sent report, so a report that changes continuously such as
+ * the mouse movement delays every other report by at most one poll.
  *
  * @return None
  */
-static void hid_send_hid_report(uint8_t starting_report_id) {
-  static uint16_t prev_system_report = 0;
-  static uint16_t prev_consumer_report = 0;
-  static hid_mouse_report_t prev_mouse_report = {0};
+static void hid_send_hid_report(void) {
+  // Report IDs start from 1
+  static uint8_t last_report_id = REPORT_ID_COUNT - 1;
 
-  for (uint8_t report_id = starting_report_id; report_id < REPORT_ID_COUNT;
-       report_id++) {
+  if (pending_reports == 0 || !hid_in_submit_window())
+    return;
+
+  for (uint32_t i = 1; i < REPORT_ID_COUNT; i++) {
+    const uint8_t report_id =
+        (last_report_id + i - 1) % (REPORT_ID_COUNT - 1) + 1;
+
+    if (!(pending_reports & (1 << report_id)))
+      continue;
+
+    pending_reports &= ~(1 << report_id);
     switch (report_id) {
     case REPORT_ID_SYSTEM_CONTROL:
       if (system_report == prev_system_report)
-        // Don't send the report if it hasn't changed
-        break;
+        // Don't send the report if it has changed back
+        continue;
       prev_system_report = system_report;
       tud_hid_n_report(USB_ITF_HID, report_id, &system_report,
                        sizeof(system_report));
-      return;
+      break;
 
     case REPORT_ID_CONSUMER_CONTROL:
       if (consumer_report == prev_consumer_report)
-        // Don't send the report if it hasn't changed
-        break;
+        // Don't send the report if it has changed back
+        continue;
       prev_consumer_report = consumer_report;
       tud_hid_n_report(USB_ITF_HID, report_id, &consumer_report,
                        sizeof(consumer_report));
-      return;
+      break;
 
     case REPORT_ID_MOUSE:
-      if (memcmp(&prev_mouse_report, &mouse_report,
-                 sizeof(prev_mouse_report)) == 0)
-        // Don't send the report if it hasn't changed
-        break;
+      if (!hid_take_mouse_movement() &&
+          mouse_report.buttons == prev_mouse_report.buttons)
+        // Don't send the report if the buttons have changed back, and there is
+        // no movement. Movement is relative so it is always sent.
+        continue;
+      if (mouse_movement[0] | mouse_movement[1] | mouse_movement[2] |
+          mouse_movement[3])
+        // Send the rest of the movement in the next report
+        pending_reports |= 1 << REPORT_ID_MOUSE;
       prev_mouse_report = mouse_report;
       tud_hid_n_report(USB_ITF_HID, report_id, &mouse_report,
                        sizeof(mouse_report));
-      return;
+      break;
 
     default:
-      break;
+      continue;
     }
+
+    last_report_id = report_id;
+    latency_report_sent();
+    return;
   }
 }
 
@@ -133,14 +279,17 @@ void hid_keycode_add(uint8_t keycode) {
 
   case SYSTEM_KEYCODE_RANGE:
     system_report = hid_code;
+    pending_reports |= 1 << REPORT_ID_SYSTEM_CONTROL;
     break;
 
   case CONSUMER_KEYCODE_RANGE:
     consumer_report = hid_code;
+    pending_reports |= 1 << REPORT_ID_CONSUMER_CONTROL;
     break;
 
   case MOUSE_KEYCODE_RANGE:
     mouse_report.buttons |= hid_code;
+    pending_reports |= 1 << REPORT_ID_MOUSE;
     break;
 
   default:
@@ -173,19 +322,24 @@ void hid_keycode_remove(uint8_t keycode) {
     break;
 
   case SYSTEM_KEYCODE_RANGE:
-    if (system_report == hid_code)
+    if (system_report == hid_code) {
       // Only remove the system report if it matches the one we're trying to
       system_report = 0;
+      pending_reports |= 1 << REPORT_ID_SYSTEM_CONTROL;
+    }
     break;
 
   case CONSUMER_KEYCODE_RANGE:
-    if (consumer_report == hid_code)
+    if (consumer_report == hid_code) {
       // Only remove the consumer report if it matches the one we're trying to
       consumer_report = 0;
+      pending_reports |= 1 << REPORT_ID_CONSUMER_CONTROL;
+    }
     break;
 
   case MOUSE_KEYCODE_RANGE:
     mouse_report.buttons &= ~hid_code;
+    pending_reports |= 1 << REPORT_ID_MOUSE;
     break;
 
   default:
@@ -193,24 +347,104 @@ void hid_keycode_remove(uint8_t keycode) {
   }
 }
 
+bool hid_report_barrier(void) {
+  const hid_nkro_kb_report_t *last_report =
+      kb_report_queue_size > 0
+          ? &kb_report_queue[(kb_report_queue_head + kb_report_queue_size - 1) &
+                             (MAX_QUEUED_KEYBOARD_REPORTS - 1)]
+          : &prev_kb_report;
+
+  if (memcmp(last_report, &kb_report, sizeof(kb_report)) == 0)
+    // Nothing to separate from the following changes
+    return true;
+
+  if (kb_report_queue_size == MAX_QUEUED_KEYBOARD_REPORTS)
+    return false;
+
+  kb_report_queue[(kb_report_queue_head + kb_report_queue_size) &
+                  (MAX_QUEUED_KEYBOARD_REPORTS - 1)] = kb_report;
+  kb_report_queue_size++;
+
+  return true;
+}
+
+void hid_mouse_move(int32_t x, int32_t y, int32_t wheel, int32_t pan) {
+  mouse_movement[0] += x;
+  mouse_movement[1] += y;
+  mouse_movement[2] += wheel;
+  mouse_movement[3] += pan;
+  pending_reports |= 1 << REPORT_ID_MOUSE;
+
+#if !defined(HID_DISABLED)
+  if (tud_hid_n_ready(USB_ITF_HID))
+    // Otherwise, the movement is sent on the next report
+    hid_send_hid_report();
+#endif
+}
+
+bool hid_ready(void) {
+#if !defined(HID_DISABLED)
+  return tud_hid_n_ready(USB_ITF_KEYBOARD) && tud_hid_n_ready(USB_ITF_HID) &&
+         kb_report_queue_size == 0 &&
+         memcmp(&prev_kb_report, &kb_report, sizeof(kb_report)) == 0 &&
+         system_report == prev_system_report &&
+         consumer_report == prev_consumer_report &&
+         mouse_report.buttons == prev_mouse_report.buttons;
+#else
+  return true;
+#endif
+}
+
+uint32_t hid_frame_count(void) { return frame_count; }
+
+bool hid_frame_count_active(void) {
+#if !defined(HID_DISABLED)
+  return is_sof_enabled && tud_mounted() && !tud_suspended();
+#else
+  return false;
+#endif
+}
+
 void hid_send_reports(void) {
+  latency_report_changed();
+
 #if !defined(HID_DISABLED)
-  if (tud_suspended())
-    // Wake up the host if it's suspended
-    tud_remote_wakeup();
+  if (tud_suspended()) {
+    if (!is_waking_up ||
+        timer_elapsed(wakeup_time) >= HID_REMOTE_WAKEUP_RETRY_MS) {
+      // Wake up the host, without restarting a wakeup in progress
+      is_waking_up = tud_remote_wakeup();
+      wakeup_time = timer_read();
+    }
+
+    if (is_waking_up)
+      // Close the report of each scan until the bus is up so that the host
+      // receives every press and release made during the wakeup in order,
+      // instead of only the latest state. If the queue is full, the following
+      // changes are merged into the current report.
+      hid_report_barrier();
+    else
+      // The host does not allow remote wakeup, so the keystrokes made while it
+      // sleeps are not replayed on a later resume. Only the latest state is
+      // kept.
+      kb_report_queue_size = 0;
+  }
 
-  while (!tud_hid_n_ready(USB_ITF_KEYBOARD))
-    // Wait for the keyboard interface to be ready
-    tud_task();
+  // The reports that cannot be submitted now are latched, and submitted when
+  // their interface is ready
+  hid_task();
+#endif
+}
 
-  hid_send_keyboard_report();
+void hid_task(void) {
+#if !defined(HID_DISABLED)
+  hid_update_sof();
 
-  while (!tud_hid_n_ready(USB_ITF_HID))
-    // Wait for the HID interface to be ready
-    tud_task();
+  if (tud_hid_n_ready(USB_ITF_KEYBOARD))
+    hid_send_keyboard_report();
 
-  // Start from the first report ID
-  hid_send_hid_report(REPORT_ID_SYSTEM_CONTROL);
+  if (tud_hid_n_ready(USB_ITF_HID))
+    hid_send_hid_report();
 #endif
 }
 
@@ -218,6 +452,35 @@ void hid_send_reports(void) {
 // TinyUSB Callbacks
 //--------------------------------------------------------------------+
 
+void tud_mount_cb(void) {
+  // Start without the start-of-frame callback. It is enabled by `hid_task()`
+  // if frame sync or phase lock is enabled.
+  tud_sof_cb_enable(false);
+  is_sof_enabled = false;
+}
+
+void tud_suspend_cb(bool remote_wakeup_en) { is_waking_up = false; }
+
+void tud_resume_cb(void) {
+  // The reports queued while the bus was suspended are sent by `hid_task()`
+  is_waking_up = false;
+}
+
+void tud_sof_cb(uint32_t frame_number) {
+  const uint32_t now = timer_read_us();
+  const uint32_t period = hid_frame_period_us();
+  const int32_t error = (int32_t)(now - (sof_time + period));
+
+  // The callback runs in `tud_task()` so it can only be late. An early
+  // callback means that the estimate is late, and a late one is only followed
+  // slowly to filter out the main loop latency, unless the estimate is lost.
+  if (error <= 0 || error >= (int32_t)period)
+    sof_time = now;
+  else
+    sof_time += (uint32_t)((int32_t)period + error / 16);
+  frame_count++;
+}
+
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id,
                                hid_report_type_t report_type, uint8_t *buffer,
                                uint16_t reqlen) {
@@ -228,12 +491,19 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
                            hid_report_type_t report_type, const uint8_t *buffer,
                            uint16_t bufsize) {
   if (instance == USB_ITF_RAW_HID)
-    command_process(buffer);
+    command_process(buffer, bufsize);
+#if defined(ANALOG_HID_ENABLED)
+  else if (instance == USB_ITF_ANALOG)
+    analog_hid_set_keys(buffer, bufsize);
+#endif
 }
 
 void tud_hid_report_complete_cb(uint8_t instance, const uint8_t *report,
                                 uint16_t len) {
-  if (instance == USB_ITF_HID)
-    // Start from the next report ID
-    hid_send_hid_report(report[0] + 1);
+  if (instance == USB_ITF_KEYBOARD)
+    // Send the next queued report, or the latest report if it has changed
+    hid_send_keyboard_report();
+  else if (instance == USB_ITF_HID)
+    // Send the next pending report
+    hid_send_hid_report();
 }
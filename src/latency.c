@@ -0,0 +1,119 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "latency.h"
+
+#include "hardware/hardware.h"
+
+// Number of CPU cycles per microsecond
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+static latency_histogram_t histograms[LATENCY_HISTOGRAM_COUNT];
+
+// Whether the last matrix scan start is known
+static bool has_scan_time;
+// Cycle count at the start of the last matrix scan
+static uint32_t scan_time;
+// Cycle count at the end of the ADC frame used by the current matrix scan
+static uint32_t scan_sample_time;
+// Whether the current matrix scan detected a key press or release, and the
+// cycle count when it was first detected
+static bool has_crossing;
+static uint32_t crossing_time;
+
+// Whether there are key changes that have not been submitted yet, and the
+// timestamps of the oldest scan with such changes
+static bool is_pending;
+static uint32_t pending_sample_time;
+static uint32_t pending_crossing_time;
+
+/**
+ * @brief Add a latency to a histogram
+ *
+ * @param id Histogram ID
+ * @param since Cycle count at the start of the latency
+ * @param now Current cycle count
+ *
+ * @return None
+ */
+static void latency_record(uint8_t id, uint32_t since, uint32_t now) {
+  latency_histogram_t *histogram = &histograms[id];
+  const uint32_t us = (now - since) / CYCLES_PER_US;
+  const uint32_t magnitude = us == 0 ? 0 : 32u - (uint32_t)__builtin_clz(us);
+  const uint32_t bucket = M_MIN(magnitude, LATENCY_NUM_BUCKETS - 1);
+
+  histogram->min_us = M_MIN(histogram->min_us, us);
+  histogram->max_us = M_MAX(histogram->max_us, us);
+  histogram->buckets[bucket]++;
+}
+
+void latency_init(void) {
+  for (uint32_t i = 0; i < LATENCY_HISTOGRAM_COUNT; i++)
+    latency_reset(i);
+}
+
+void latency_scan_begin(void) {
+  const uint32_t now = board_cycle_count();
+
+  if (has_scan_time)
+    latency_record(LATENCY_SCAN_PERIOD, scan_time, now);
+  has_scan_time = true;
+  scan_time = now;
+  scan_sample_time = analog_frame_time();
+  has_crossing = false;
+}
+
+void latency_crossing(void) {
+  if (has_crossing)
+    return;
+
+  has_crossing = true;
+  crossing_time = board_cycle_count();
+}
+
+void latency_report_changed(void) {
+  if (is_pending || !has_crossing)
+    // Keep the oldest changes. The report changes without a key press or
+    // release, such as the macro steps, are not measured.
+    return;
+
+  is_pending = true;
+  pending_sample_time = scan_sample_time;
+  pending_crossing_time = crossing_time;
+}
+
+void latency_report_sent(void) {
+  if (!is_pending)
+    return;
+
+  const uint32_t now = board_cycle_count();
+
+  latency_record(LATENCY_SAMPLE_TO_REPORT, pending_sample_time, now);
+  latency_record(LATENCY_CROSSING_TO_REPORT, pending_crossing_time, now);
+  is_pending = false;
+}
+
+const latency_histogram_t *latency_histogram(uint8_t id) {
+  return id < LATENCY_HISTOGRAM_COUNT ? &histograms[id] : NULL;
+}
+
+void latency_reset(uint8_t id) {
+  if (id >= LATENCY_HISTOGRAM_COUNT)
+    return;
+
+  memset(&histograms[id], 0, sizeof(histograms[id]));
+  histograms[id].min_us = UINT32_MAX;
+}
@@ -22,7 +22,9 @@
 #include "hardware/hardware.h"
 #include "hid.h"
 #include "keycodes.h"
+#include "macro.h"
 #include "matrix.h"
+#include "mouse.h"
 #include "xinput.h"
 
 // Layer mask. Each bit represents whether a layer is active or not.
@@ -109,14 +111,21 @@ static uint8_t active_keycodes[NUM_KEYS];
 static uint8_t advanced_key_indices[NUM_LAYERS][NUM_KEYS];
 // Same as `active_keycodes` but for advanced keys
 static uint8_t active_advanced_keys[NUM_KEYS];
+// Hold event subscription of each advanced key
+static uint8_t hold_subscriptions[NUM_ADVANCED_KEYS];
+// Key travel distance of the last event dispatched to the advanced key
+static uint8_t last_hold_distances[NUM_KEYS];
 
 void layout_init(void) { layout_load_advanced_keys(); }
 
 void layout_load_advanced_keys(void) {
+  advanced_key_load();
+
   memset(advanced_key_indices, 0, sizeof(advanced_key_indices));
   for (uint32_t i = 0; i < NUM_ADVANCED_KEYS; i++) {
     const advanced_key_t *ak = &CURRENT_PROFILE.advanced_keys[i];
 
+    hold_subscriptions[i] = advanced_key_hold_subscription(ak);
     if (ak->type == AK_TYPE_NONE || ak->layer >= NUM_LAYERS ||
         ak->key >= NUM_KEYS)
       continue;
@@ -125,13 +134,175 @@ void layout_load_advanced_keys(void) {
     if (ak->type == AK_TYPE_NULL_BIND && ak->null_bind.secondary_key < NUM_KEYS)
       // Null Bind advanced keys also have a secondary key
       advanced_key_indices[ak->layer][ak->null_bind.secondary_key] = i + 1;
+    else if (ak->type == AK_TYPE_SOCD_GROUP) {
+      // SOCD groups also have up to 7 other keys
+      for (uint32_t j = 0; j < SOCD_GROUP_MAX_KEYS - 1; j++) {
+        if (ak->socd_group.keys[j] < NUM_KEYS)
+          advanced_key_indices[ak->layer][ak->socd_group.keys[j]] = i + 1;
+      }
+    }
   }
 }
 
-void layout_task(void) {
-  static advanced_key_event_t ak_event = {0};
-  static uint32_t last_ak_tick = 0;
+// Buffered key event
+typedef struct {
+  // Key index
+  uint8_t key;
+  // Whether the event is a key press or a key release
+  bool is_press;
+} key_event_t;
+
+// Key events delayed until the permissive hold Tap-Hold keys are resolved. The
+// events are replayed in order, one per matrix scan, so that each of them
+// lands in its own report.
+static key_event_t key_events[MAX_BUFFERED_KEY_EVENTS];
+static uint32_t key_event_head;
+static uint32_t key_event_count;
+// Whether the key has an event in the buffer
+static bitmap_t key_event_buffered[] = MAKE_BITMAP(NUM_KEYS);
+
+static advanced_key_event_t ak_event;
+
+/**
+ * @brief Process a key press or release event
+ *
+ * @param current_layer Current layer
+ * @param key Key index
+ * @param is_press Whether the event is a key press or a key release
+ *
+ * @return true if the event is a non-Tap-Hold key press, false otherwise
+ */
+static bool layout_process_key_event(uint8_t current_layer, uint8_t key,
+                                     bool is_press) {
+  if (is_press) {
+    // Key press event
+    const uint8_t keycode = layout_get_keycode(current_layer, key);
+    const uint8_t ak_index = advanced_key_indices[current_layer][key];
+
+    if (ak_index) {
+      active_advanced_keys[key] = ak_index;
+      last_hold_distances[key] = key_matrix[key].distance;
+      ak_event = (advanced_key_event_t){
+          .type = AK_EVENT_TYPE_PRESS,
+          .key = key,
+          .keycode = keycode,
+          .ak_index = ak_index - 1,
+      };
+      advanced_key_process(&ak_event);
+      return CURRENT_PROFILE.advanced_keys[ak_index - 1].type !=
+             AK_TYPE_TAP_HOLD;
+    }
+
+    active_keycodes[key] = keycode;
+    layout_register(key, keycode);
+    return keycode != KC_NO;
+  }
+
+  // Key release event
+  const uint8_t keycode = active_keycodes[key];
+  const uint8_t ak_index = active_advanced_keys[key];
+
+  if (ak_index) {
+    active_advanced_keys[key] = 0;
+    ak_event = (advanced_key_event_t){
+        .type = AK_EVENT_TYPE_RELEASE,
+        .key = key,
+        .keycode = keycode,
+        .ak_index = ak_index - 1,
+    };
+    advanced_key_process(&ak_event);
+  } else {
+    active_keycodes[key] = KC_NO;
+    layout_unregister(key, keycode);
+  }
+
+  return false;
+}
+
+/**
+ * @brief Replay the oldest buffered key event
+ *
+ * The keycode is resolved at replay time, so the key event observes the layer
+ * activated by the hold action.
+ *
+ * @return true if the event is a non-Tap-Hold key press, false otherwise
+ */
+static bool layout_replay_key_event(void) {
+  const key_event_t *e = &key_events[key_event_head];
+
+  key_event_head = (key_event_head + 1) & (MAX_BUFFERED_KEY_EVENTS - 1);
+  key_event_count--;
+
+  // Keep the key marked until its last buffered event is replayed
+  bool is_buffered = false;
+  for (uint32_t i = 0; i < key_event_count; i++)
+    is_buffered |=
+        key_events[(key_event_head + i) & (MAX_BUFFERED_KEY_EVENTS - 1)].key ==
+        e->key;
+  bitmap_set(key_event_buffered, e->key, is_buffered);
+
+  const bool is_non_tap_hold_press =
+      layout_process_key_event(layout_get_current_layer(), e->key, e->is_press);
+  // Submitting reports does not wait for the host, so the replayed events
+  // must be closed into their own reports to not be merged with the next ones
+  hid_report_barrier();
+
+  return is_non_tap_hold_press;
+}
+
+/**
+ * @brief Handle a key press or release event
+ *
+ * While a permissive hold Tap-Hold key is undecided, or the buffer still holds
+ * earlier events, the event is buffered to preserve the event order. Only the
+ * release of an undecided permissive hold Tap-Hold key is processed
+ * immediately since it decides the key.
+ *
+ * @param current_layer Current layer
+ * @param key Key index
+ * @param is_press Whether the event is a key press or a key release
+ *
+ * @return true if the event is a non-Tap-Hold key press, false otherwise
+ */
+static bool layout_handle_key_event(uint8_t current_layer, uint8_t key,
+                                    bool is_press) {
+  const uint8_t ak_index = active_advanced_keys[key];
+  bool has_non_tap_hold_press = false;
+  bool should_buffer;
+
+  if (is_press)
+    should_buffer = (key_event_count > 0) | advanced_key_has_permissive_hold();
+  else if (bitmap_get(key_event_buffered, key)) {
+    // A key is pressed and released while the Tap-Hold key is held.
+    advanced_key_permissive_hold();
+    should_buffer = true;
+  } else
+    // The key is pressed before the buffering started. Its release stays
+    // behind the buffered events unless it decides a Tap-Hold key.
+    should_buffer =
+        (key_event_count > 0) &
+        !(ak_index && advanced_key_is_permissive_hold(ak_index - 1));
+
+  if (should_buffer) {
+    if (key_event_count == MAX_BUFFERED_KEY_EVENTS) {
+      // The buffer is full. Resolve to hold, and make room for the new event.
+      advanced_key_permissive_hold();
+      has_non_tap_hold_press = layout_replay_key_event();
+    }
+
+    key_events[(key_event_head + key_event_count) &
+               (MAX_BUFFERED_KEY_EVENTS - 1)] =
+        (key_event_t){.key = key, .is_press = is_press};
+    key_event_count++;
+    bitmap_set(key_event_buffered, key, true);
 
+    return has_non_tap_hold_press;
+  }
+
+  return layout_process_key_event(current_layer, key, is_press);
+}
+
+void layout_task(void) {
   const uint8_t current_layer = layout_get_current_layer();
   bool has_non_tap_hold_press = false;
 
@@ -161,52 +332,23 @@ void layout_task(void) {
       // Only keys in layer 0 can be disabled.
       continue;
 
-    if (k->is_pressed & !last_key_press) {
-      // Key press event
-      const uint8_t keycode = layout_get_keycode(current_layer, i);
-      const uint8_t ak_index = advanced_key_indices[current_layer][i];
-
-      if (ak_index) {
-        active_advanced_keys[i] = ak_index;
-        ak_event = (advanced_key_event_t){
-            .type = AK_EVENT_TYPE_PRESS,
-            .key = i,
-            .keycode = keycode,
-            .ak_index = ak_index - 1,
-        };
-        advanced_key_process(&ak_event);
-        has_non_tap_hold_press |=
-            (CURRENT_PROFILE.advanced_keys[ak_index - 1].type !=
-             AK_TYPE_TAP_HOLD);
-      } else {
-        active_keycodes[i] = keycode;
-        layout_register(i, keycode);
-        has_non_tap_hold_press |= (keycode != KC_NO);
-      }
-    } else if (!k->is_pressed & last_key_press) {
-      // Key release event
-      const uint8_t keycode = active_keycodes[i];
-      const uint8_t ak_index = active_advanced_keys[i];
-
-      if (ak_index) {
-        active_advanced_keys[i] = 0;
-        ak_event = (advanced_key_event_t){
-            .type = AK_EVENT_TYPE_RELEASE,
-            .key = i,
-            .keycode = keycode,
-            .ak_index = ak_index - 1,
-        };
-        advanced_key_process(&ak_event);
-      } else {
-        active_keycodes[i] = KC_NO;
-        layout_unregister(i, keycode);
-      }
-    } else if (k->is_pressed) {
+    if (k->is_pressed != last_key_press)
+      // Key press or release event
+      has_non_tap_hold_press |=
+          layout_handle_key_event(current_layer, i, k->is_pressed);
+    else if (k->is_pressed) {
       // Key hold event
       const uint8_t keycode = active_keycodes[i];
       const uint8_t ak_index = active_advanced_keys[i];
 
-      if (ak_index) {
+      if (ak_index &&
+          // Only dispatch the hold events the advanced key subscribed to
+          ((hold_subscriptions[ak_index - 1] ==
+            AK_HOLD_SUBSCRIPTION_EVERY_SCAN) |
+           ((hold_subscriptions[ak_index - 1] ==
+             AK_HOLD_SUBSCRIPTION_ON_CHANGE) &
+            (k->distance != last_hold_distances[i])))) {
+        last_hold_distances[i] = k->distance;
         ak_event = (advanced_key_event_t){
             .type = AK_EVENT_TYPE_HOLD,
             .key = i,
@@ -221,13 +363,24 @@ void layout_task(void) {
     bitmap_set(key_press_states, i, k->is_pressed);
   }
 
-  if (has_non_tap_hold_press || timer_elapsed(last_ak_tick) > 0) {
-    // We only need to tick the advanced keys every 1ms, or when there is a
-    // non-Tap-Hold key press event since these are the only cases that
-    // the advanced keys might perform an action.
+  if ((key_event_count > 0) &&
+      (!advanced_key_has_permissive_hold() |
+       !key_events[key_event_head].is_press))
+    // The Tap-Hold keys are resolved, or the next buffered key event is the
+    // release of a key pressed before them, which does not affect them. Replay
+    // the next buffered key event.
+    has_non_tap_hold_press |= layout_replay_key_event();
+
+  if (has_non_tap_hold_press || advanced_key_timer_expired())
+    // We only need to tick the advanced keys when one of their timers has
+    // expired, or when there is a non-Tap-Hold key press event since these
+    // are the only cases that the advanced keys might perform an action.
     advanced_key_tick(has_non_tap_hold_press);
-    last_ak_tick = timer_read();
-  }
+
+  // Play the next macro step, if any, in the upcoming report
+  macro_task();
+  // Accumulate the mouse movement since the last matrix scan
+  mouse_task();
 
   if (should_send_reports) {
     hid_send_reports();
@@ -271,6 +424,10 @@ void layout_register(uint8_t key, uint8_t keycode) {
     should_send_reports = true;
     break;
 
+  case MOUSE_MOVE_KEYCODE_RANGE:
+    mouse_register(key, keycode);
+    break;
+
   case MOMENTARY_LAYER_RANGE:
     layout_layer_on(MO_GET_LAYER(keycode));
     break;
@@ -300,6 +457,10 @@ void layout_register(uint8_t key, uint8_t keycode) {
     board_enter_bootloader();
     break;
 
+  case MACRO_RANGE:
+    macro_play(key, MC_GET_MACRO(keycode));
+    break;
+
   default:
     break;
   }
@@ -315,6 +476,10 @@ void layout_unregister(uint8_t key, uint8_t keycode) {
     should_send_reports = true;
     break;
 
+  case MOUSE_MOVE_KEYCODE_RANGE:
+    mouse_unregister(key, keycode);
+    break;
+
   case MOMENTARY_LAYER_RANGE:
     layout_layer_off(MO_GET_LAYER(keycode));
     break;
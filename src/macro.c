@@ -0,0 +1,162 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "macro.h"
+
+#include "bitmap.h"
+#include "eeconfig.h"
+#include "hardware/hardware.h"
+#include "hid.h"
+#include "keycodes.h"
+#include "layout.h"
+
+// Length of each instruction in bytes, including the opcode
+static const uint8_t macro_op_len[] = {
+    [MACRO_OP_END] = 1,   [MACRO_OP_TAP] = 2,   [MACRO_OP_PRESS] = 2,
+    [MACRO_OP_RELEASE] = 2, [MACRO_OP_DELAY] = 3,
+};
+
+_Static_assert(M_ARRAY_SIZE(macro_op_len) == MACRO_OP_COUNT,
+               "Invalid macro opcode length table size");
+
+static bool is_playing;
+// Key index that triggered the current macro
+static uint8_t trigger_key;
+// Offset of the next instruction in the macro buffer
+static uint32_t position;
+// Keycode to release in the next step to complete a `MACRO_OP_TAP`
+static uint8_t pending_release;
+// Time when the current `MACRO_OP_DELAY` started
+static uint32_t delay_since;
+static uint16_t delay_ms;
+// Keycodes currently registered by the macro. They are released when the
+// macro ends so that a macro can never leave a key stuck.
+static bitmap_t pressed_keycodes[] = MAKE_BITMAP(256);
+
+/**
+ * @brief Find the start of a macro in the macro buffer
+ *
+ * Unknown opcodes are treated as `MACRO_OP_END`, which is consistent with how
+ * they are handled during playback.
+ *
+ * @param macro Macro index
+ *
+ * @return Offset of the first instruction of the macro
+ */
+static uint32_t macro_find(uint8_t macro) {
+  uint32_t pos = 0;
+
+  while (macro > 0 && pos < MACRO_BUFFER_SIZE) {
+    const uint8_t op = eeconfig->macros[pos];
+
+    if (op == MACRO_OP_END || op >= MACRO_OP_COUNT) {
+      macro--;
+      pos++;
+    } else
+      pos += macro_op_len[op];
+  }
+
+  return pos;
+}
+
+static void macro_register(uint8_t keycode) {
+  if (bitmap_get(pressed_keycodes, keycode))
+    return;
+
+  layout_register(trigger_key, keycode);
+  bitmap_set(pressed_keycodes, keycode, true);
+}
+
+static void macro_unregister(uint8_t keycode) {
+  if (!bitmap_get(pressed_keycodes, keycode))
+    return;
+
+  layout_unregister(trigger_key, keycode);
+  bitmap_set(pressed_keycodes, keycode, false);
+}
+
+void macro_play(uint8_t key, uint8_t macro) {
+  if (is_playing || macro >= NUM_MACROS)
+    return;
+
+  is_playing = true;
+  trigger_key = key;
+  position = macro_find(macro);
+  pending_release = KC_NO;
+  delay_ms = 0;
+}
+
+void macro_stop(void) {
+  if (!is_playing)
+    return;
+
+  for (uint32_t w = 0; w < M_ARRAY_SIZE(pressed_keycodes); w++) {
+    // Only visit the keycodes that the macro has registered
+    for (bitmap_t bits = pressed_keycodes[w]; bits; bits &= bits - 1)
+      macro_unregister(w * 32 + (uint32_t)__builtin_ctz(bits));
+  }
+  is_playing = false;
+}
+
+void macro_task(void) {
+  if (!is_playing || !hid_ready())
+    // Wait for the previous report to be consumed by the host
+    return;
+
+  if (delay_ms > 0) {
+    if (timer_elapsed(delay_since) < delay_ms)
+      return;
+    delay_ms = 0;
+  }
+
+  if (pending_release != KC_NO) {
+    // Release the tapped key in its own report
+    macro_unregister(pending_release);
+    pending_release = KC_NO;
+    return;
+  }
+
+  const uint8_t *buf = eeconfig->macros;
+  uint8_t op = position < MACRO_BUFFER_SIZE ? buf[position] : MACRO_OP_END;
+  if (op >= MACRO_OP_COUNT ||
+      position + macro_op_len[op] > MACRO_BUFFER_SIZE)
+    // Unknown or truncated instruction
+    op = MACRO_OP_END;
+
+  switch (op) {
+  case MACRO_OP_TAP:
+    macro_register(buf[position + 1]);
+    pending_release = buf[position + 1];
+    break;
+
+  case MACRO_OP_PRESS:
+    macro_register(buf[position + 1]);
+    break;
+
+  case MACRO_OP_RELEASE:
+    macro_unregister(buf[position + 1]);
+    break;
+
+  case MACRO_OP_DELAY:
+    delay_ms = buf[position + 1] | ((uint16_t)buf[position + 2] << 8);
+    delay_since = timer_read();
+    break;
+
+  default:
+    macro_stop();
+    return;
+  }
+  position += macro_op_len[op];
+}
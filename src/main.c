@@ -14,16 +14,21 @@
  */
 
 #include "advanced_keys.h"
+#include "analog_hid.h"
 #include "commands.h"
 #include "crc32.h"
 #include "deferred_actions.h"
 #include "eeconfig.h"
 #include "hardware/hardware.h"
 #include "hid.h"
+#include "latency.h"
 #include "layout.h"
 #include "log.h"
+#include "macro.h"
 #include "matrix.h"
+#include "mouse.h"
 #include "tusb.h"
+#include "vendor.h"
 #include "wear_leveling.h"
 #include "xinput.h"
 
@@ -43,14 +48,20 @@ int main(void) {
   eeconfig_init();
 
   // Initialize the core modules
+  latency_init();
   analog_init();
   matrix_init();
   hid_init();
   deferred_action_init();
   advanced_key_init();
+  mouse_init();
   xinput_init();
+#if defined(ANALOG_HID_ENABLED)
+  analog_hid_init();
+#endif
   layout_init();
   command_init();
+  vendor_init();
 
   tud_init(BOARD_TUD_RHPORT);
 
@@ -60,7 +71,13 @@ int main(void) {
     analog_task();
     matrix_scan();
     layout_task();
+    hid_task();
     xinput_task();
+    command_task();
+    vendor_task();
+#if defined(ANALOG_HID_ENABLED)
+    analog_hid_task();
+#endif
 #if defined(LOG_ENABLED)
     log_task();
 #endif
@@ -19,6 +19,7 @@
 #include "distance.h"
 #include "eeconfig.h"
 #include "hardware/hardware.h"
+#include "latency.h"
 
 // Exponential moving average (EMA) filter
 #define EMA(x, y)                                                              \
@@ -86,7 +87,10 @@ void matrix_recalibrate(void) {
 }
 
 void matrix_scan(void) {
+  latency_scan_begin();
+
   for (uint32_t i = 0; i < NUM_KEYS; i++) {
+    const bool was_pressed = key_matrix[i].is_pressed;
     const uint16_t new_adc_filtered =
         EMA(matrix_analog_read(i), key_matrix[i].adc_filtered);
     const actuation_t *actuation = &CURRENT_PROFILE.actuation_map[i];
@@ -160,6 +164,9 @@ void matrix_scan(void) {
         break;
       }
     }
+
+    if (key_matrix[i].is_pressed != was_pressed)
+      latency_crossing();
   }
 }
 
@@ -21,6 +21,9 @@
 static bool v1_1_global_config_func(uint8_t *dst, const uint8_t *src);
 static bool v1_1_profile_config_func(uint8_t profile, uint8_t *dst,
                                      const uint8_t *src);
+static bool v1_2_global_config_func(uint8_t *dst, const uint8_t *src);
+static bool v1_2_profile_config_func(uint8_t profile, uint8_t *dst,
+                                     const uint8_t *src);
 
 // Migration metadata for each configuration version. The first entry is
 // reserved for the initial version (v1.0) which does not require migration.
@@ -47,6 +50,20 @@ static const migration_t migrations[] = {
         .global_config_func = v1_1_global_config_func,
         .profile_config_func = v1_1_profile_config_func,
     },
+    {
+        .version = 0x0102,
+        .global_config_size = 14 + MACRO_BUFFER_SIZE,
+        .profile_config_size = NUM_LAYERS * NUM_KEYS    // Keymap
+                               + NUM_KEYS * 4           // Actuation map
+                               + NUM_ADVANCED_KEYS * 12 // Advanced keys
+                               + NUM_KEYS               // Gamepad buttons
+                               + 9                      // Gamepad options
+                               + 1                      // Tick rate
+                               + 10                     // Mouse options
+        ,
+        .global_config_func = v1_2_global_config_func,
+        .profile_config_func = v1_2_profile_config_func,
+    },
 };
 
 bool migration_try_migrate(void) {
@@ -55,9 +72,10 @@ bool migration_try_migrate(void) {
     return false;
 
   const uint16_t config_version = eeconfig->version;
-  // We alternate between two buffers to save the memory.
+  // We alternate between two buffers to save the memory. They are static since
+  // the configuration is too large for the stack.
   uint8_t current_buf = 0;
-  uint8_t bufs[2][sizeof(eeconfig_t)];
+  static uint8_t bufs[2][sizeof(eeconfig_t)];
 
   // Let `bufs[0]` be the current configuration.
   memcpy(bufs[0], eeconfig, sizeof(eeconfig_t));
@@ -185,3 +203,48 @@ bool v1_1_profile_config_func(uint8_t profile, uint8_t *dst,
 
   return true;
 }
+
+//--------------------------------------------------------------------+
+// v1.1 -> v1.2 Migration
+//--------------------------------------------------------------------+
+
+bool v1_2_global_config_func(uint8_t *dst, const uint8_t *src) {
+  if (((eeconfig_t *)src)->version != 0x0101)
+    // Expected version v1.1
+    return false;
+
+  // Save the `options` offset
+  uint8_t *options = dst + 10;
+  // Copy `magic_start` to `last_non_default_profile`
+  migration_memcpy(&dst, &src, 14);
+  // Default `xinput_polling_rate` (bits 9-10 of `options`) to 1kHz, which is
+  // the polling rate of the XInput interface before it was configurable
+  options[1] |= USB_POLLING_RATE_1000HZ << 1;
+  // Default `macros` to empty macros
+  migration_memset(&dst, 0, MACRO_BUFFER_SIZE);
+
+  return true;
+}
+
+bool v1_2_profile_config_func(uint8_t profile, uint8_t *dst,
+                              const uint8_t *src) {
+  // Save the `advanced_keys` offset
+  uint8_t *advanced_keys = dst + (NUM_LAYERS * NUM_KEYS) + (NUM_KEYS * 4);
+  // Copy `keymap` to `tick_rate`
+  migration_memcpy(&dst, &src, migrations[1].profile_config_size);
+  // Default `mouse_options`
+  migration_assign_uint8_t(&dst, 4), migration_assign_uint8_t(&dst, 20);
+  migration_assign_uint8_t(&dst, 85), migration_assign_uint8_t(&dst, 95);
+  migration_assign_uint8_t(&dst, 165), migration_assign_uint8_t(&dst, 170);
+  migration_assign_uint8_t(&dst, 255), migration_assign_uint8_t(&dst, 255);
+  migration_assign_uint8_t(&dst, 100), migration_assign_uint8_t(&dst, 20);
+  // Default `hold_point`, `hold_dwell`, `tap_release_velocity`, and
+  // `permissive_hold` to 0
+  for (uint8_t i = 0; i < NUM_ADVANCED_KEYS; i++) {
+    uint8_t *ak = advanced_keys + i * 12;
+    if (ak[2] == AK_TYPE_TAP_HOLD)
+      memset(&ak[8], 0, 4);
+  }
+
+  return true;
+}
@@ -0,0 +1,108 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mouse.h"
+
+#include "eeconfig.h"
+#include "hardware/hardware.h"
+#include "hid.h"
+#include "keycodes.h"
+#include "lib/analog_curve.h"
+#include "matrix.h"
+
+// Mouse directions, in the same order as the mouse movement keycodes. Each
+// pair of directions shares an axis, with the negative direction first.
+#define MOUSE_NUM_DIRECTIONS 8
+#define MOUSE_NUM_AXES (MOUSE_NUM_DIRECTIONS / 2)
+
+// Accumulator units per pixel. A cursor key at full speed adds
+// `255 * speed` units per microsecond, where `speed` is in 10 pixels per
+// second.
+#define MOUSE_CURSOR_UNIT (255 * 100000)
+// Accumulator units per wheel notch. A wheel key at full speed adds
+// `255 * wheel_speed` units per microsecond, where `wheel_speed` is in notches
+// per second.
+#define MOUSE_WHEEL_UNIT (255 * 1000000)
+// Maximum elapsed time between two mouse tasks. This bounds the accumulators
+// after a long pause, e.g., when the host is suspended.
+#define MOUSE_MAX_ELAPSED_US 10000
+
+// Key index of each active direction
+static uint8_t direction_keys[MOUSE_NUM_DIRECTIONS];
+// Bitmask of the active directions
+static uint8_t active_directions;
+// Sub-pixel movement of each axis (x, y, wheel, pan)
+static int32_t accumulators[MOUSE_NUM_AXES];
+// Time of the last mouse task in microseconds
+static uint32_t last_task_us;
+
+void mouse_init(void) {}
+
+void mouse_register(uint8_t key, uint8_t keycode) {
+  const uint8_t direction = keycode - SP_MOUSE_MOVE_LEFT;
+
+  direction_keys[direction] = key;
+  active_directions |= 1 << direction;
+}
+
+void mouse_unregister(uint8_t key, uint8_t keycode) {
+  const uint8_t direction = keycode - SP_MOUSE_MOVE_LEFT;
+
+  if (direction_keys[direction] == key)
+    // Another key may have taken over the direction
+    active_directions &= ~(1 << direction);
+}
+
+void mouse_task(void) {
+  const uint32_t now = timer_read_us();
+  const uint32_t elapsed = M_MIN(now - last_task_us, MOUSE_MAX_ELAPSED_US);
+  last_task_us = now;
+
+  if (!active_directions) {
+    // Drop the sub-pixel movement once all the keys are released
+    memset(accumulators, 0, sizeof(accumulators));
+    return;
+  }
+
+  const mouse_options_t *options = &CURRENT_PROFILE.mouse_options;
+  bool is_key_end_deadzone;
+
+  for (uint32_t bits = active_directions; bits; bits &= bits - 1) {
+    const uint32_t direction = (uint32_t)__builtin_ctz(bits);
+    const int32_t speed =
+        (int32_t)apply_analog_curve(
+            options->analog_curve,
+            key_matrix[direction_keys[direction]].distance,
+            &is_key_end_deadzone) *
+        (direction < 4 ? options->speed : options->wheel_speed);
+    const int32_t delta = speed * (int32_t)elapsed;
+
+    accumulators[direction / 2] += (direction & 1) ? delta : -delta;
+  }
+
+  int32_t movement[MOUSE_NUM_AXES];
+  bool has_movement = false;
+  for (uint32_t i = 0; i < MOUSE_NUM_AXES; i++) {
+    const int32_t unit = i < 2 ? MOUSE_CURSOR_UNIT : MOUSE_WHEEL_UNIT;
+
+    // Keep the remainder for the next task
+    movement[i] = accumulators[i] / unit;
+    accumulators[i] -= movement[i] * unit;
+    has_movement |= (movement[i] != 0);
+  }
+
+  if (has_movement)
+    hid_mouse_move(movement[0], movement[1], movement[2], movement[3]);
+}
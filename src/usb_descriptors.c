@@ -116,14 +116,39 @@ static const uint8_t desc_log_report[] = {
 
 };
 
-#define CONFIG_TOTAL_LEN                                                       \
-  (TUD_CONFIG_DESC_LEN + 3 * TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN +       \
-   XINPUT_DESC_LEN)
+#define LOG_DESC_LEN TUD_HID_DESC_LEN
 #else
+#define LOG_DESC_LEN 0
+#endif
+
+#if defined(ANALOG_HID_ENABLED)
+// HID report descriptor for the analog interface
+static const uint8_t desc_analog_report[] = {
+    HID_USAGE_PAGE_N(ANALOG_HID_USAGE_PAGE, 2), HID_USAGE(ANALOG_HID_USAGE),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+
+    // Key distances to host
+    HID_USAGE(ANALOG_HID_USAGE + 1), HID_LOGICAL_MIN(0),
+    HID_LOGICAL_MAX_N(255, 2), HID_REPORT_COUNT(ANALOG_HID_EP_SIZE),
+    HID_REPORT_SIZE(8), HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+
+    // Streamed keys from host
+    HID_USAGE(ANALOG_HID_USAGE + 2), HID_LOGICAL_MIN(0),
+    HID_LOGICAL_MAX_N(255, 2), HID_REPORT_COUNT(M_DIV_CEIL(NUM_KEYS, 8)),
+    HID_REPORT_SIZE(8),
+    HID_OUTPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_NON_VOLATILE),
+    HID_COLLECTION_END
+
+};
+
+#define ANALOG_HID_DESC_LEN TUD_HID_DESC_LEN
+#else
+#define ANALOG_HID_DESC_LEN 0
+#endif
+
 #define CONFIG_TOTAL_LEN                                                       \
   (TUD_CONFIG_DESC_LEN + 2 * TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN +       \
-   XINPUT_DESC_LEN)
-#endif
+   LOG_DESC_LEN + ANALOG_HID_DESC_LEN + TUD_VENDOR_DESC_LEN + XINPUT_DESC_LEN)
 
 // Configuration descriptor
 static uint8_t desc_configuration[] = {
@@ -147,6 +172,16 @@ static uint8_t desc_configuration[] = {
     TUD_HID_DESCRIPTOR(USB_ITF_LOG, 0, HID_ITF_PROTOCOL_NONE,
                        sizeof(desc_log_report), EP_IN_ADDR_LOG, LOG_EP_SIZE, 1),
 #endif
+#if defined(ANALOG_HID_ENABLED)
+    // Analog HID interface descriptor. Request highest polling interval
+    TUD_HID_DESCRIPTOR(USB_ITF_ANALOG, 0, HID_ITF_PROTOCOL_NONE,
+                       sizeof(desc_analog_report), EP_IN_ADDR_ANALOG,
+                       ANALOG_HID_EP_SIZE, 1),
+#endif
+    // Vendor interface descriptor. The endpoint size is updated for the bus
+    // speed.
+    TUD_VENDOR_DESCRIPTOR(USB_ITF_VENDOR, 0, EP_OUT_ADDR_VENDOR,
+                          EP_IN_ADDR_VENDOR, VENDOR_EP_SIZE_FS),
     // XInput interface descriptor
     XINPUT_DESCRIPTOR(USB_ITF_XINPUT, 0, EP_OUT_ADDR_XINPUT, EP_IN_ADDR_XINPUT),
 };
@@ -206,23 +241,36 @@ static const uint8_t desc_ms_os_10[] = {
 };
 
 #define MS_OS_10_COMPAT_ID_TOTAL_LEN                                           \
-  (MS_OS_10_COMPAT_ID_DESC_LEN + MS_OS_10_COMPAT_ID_FUNCTION_DESC_LEN)
+  (MS_OS_10_COMPAT_ID_DESC_LEN + 2 * MS_OS_10_COMPAT_ID_FUNCTION_DESC_LEN)
 
-// Microsoft OS 1.0 compatibility ID descriptor
-static const uint8_t desc_ms_os_10_compat_id[] = {
+// Microsoft OS 1.0 compatibility ID descriptor. The XInput section is last so
+// that it can be removed if XInput is not enabled.
+static uint8_t desc_ms_os_10_compat_id[] = {
     // Total length of the compatibility ID descriptor
     U32_TO_U8S_LE(MS_OS_10_COMPAT_ID_TOTAL_LEN),
     // Descriptor version
     U16_TO_U8S_LE(0x0100),
     // Descriptor index
     U16_TO_U8S_LE(0x0004),
-    // Number of sections. Only one section for compatibility ID is needed.
-    U16_TO_U8S_LE(0X0001),
+    // Number of sections
+    U16_TO_U8S_LE(0X0002),
     // Reserved
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
-    // First interface of the section to apply compatibility ID. Only XInput
-    // interface requires compatibility ID.
+    // First interface of the section to apply compatibility ID. The vendor
+    // interface uses WinUSB so that it can be accessed without a driver, e.g.
+    // from WebUSB.
+    USB_ITF_VENDOR,
+    // Reserved
+    0x01,
+    // Compatibility ID: WinUSB
+    'W', 'I', 'N', 'U', 'S', 'B', 0x00, 0x00,
+    // Sub-compatibility ID
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // Reserved
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+    // First interface of the section to apply compatibility ID
     USB_ITF_XINPUT,
     // Reserved
     0x01,
@@ -296,6 +344,23 @@ _Static_assert(M_ARRAY_SIZE(desc_ms_os_10_properties) ==
 // TinyUSB Callbacks
 //--------------------------------------------------------------------+
 
+/**
+ * @brief Get the endpoint interval for a polling rate
+ *
+ * @param polling_rate Polling rate. See `usb_polling_rate_t`.
+ * @param is_high_speed Whether the descriptor is for USB high-speed
+ *
+ * @return `bInterval` of the endpoint descriptor
+ */
+static uint8_t usb_polling_interval(uint8_t polling_rate, bool is_high_speed) {
+  if (!is_high_speed)
+    // Full-speed intervals are in frames of 1ms
+    return 1;
+
+  // High-speed intervals are 2^(bInterval - 1) microframes of 125us
+  return polling_rate + 1;
+}
+
 /**
  * @brief Update the configuration descriptor based on the current persistent
  * configuration
@@ -303,18 +368,57 @@ _Static_assert(M_ARRAY_SIZE(desc_ms_os_10_properties) ==
  * This function must be called before returning the configuration descriptor.
  *
  * @param desc Pointer to the configuration descriptor
+ * @param is_high_speed Whether the descriptor is for USB high-speed
  *
  * @return None
  */
-static void update_desc_configuration(uint8_t *desc) {
+static void update_desc_configuration(uint8_t *desc, bool is_high_speed) {
   tusb_desc_configuration_t *config = (tusb_desc_configuration_t *)desc;
+  const eeconfig_options_t *options = &eeconfig->options;
+  const uint8_t polling_rates[USB_ITF_COUNT] = {
+      [USB_ITF_KEYBOARD] = options->keyboard_polling_rate,
+      [USB_ITF_HID] = options->hid_polling_rate,
+      [USB_ITF_RAW_HID] = options->raw_hid_polling_rate,
+#if defined(LOG_ENABLED)
+      [USB_ITF_LOG] = USB_POLLING_RATE_8000HZ,
+#endif
+#if defined(ANALOG_HID_ENABLED)
+      [USB_ITF_ANALOG] = USB_POLLING_RATE_8000HZ,
+#endif
+      [USB_ITF_XINPUT] = options->xinput_polling_rate,
+  };
 
-  if (!eeconfig->options.xinput_enabled) {
+  // The options may change at runtime so the descriptor is always rebuilt
+  config->bNumInterfaces = USB_ITF_COUNT;
+  config->wTotalLength = CONFIG_TOTAL_LEN;
+  if (!options->xinput_enabled) {
     // If XInput is not enabled, subtract the XInput descriptor length
     // from the total configuration length.
     config->bNumInterfaces = USB_ITF_COUNT - 1;
     config->wTotalLength = CONFIG_TOTAL_LEN - XINPUT_DESC_LEN;
   }
+
+  uint8_t itf = 0;
+  for (uint8_t *p = desc; p < desc + CONFIG_TOTAL_LEN;
+       p = (uint8_t *)tu_desc_next(p)) {
+    if (p[1] == TUSB_DESC_INTERFACE) {
+      itf = ((tusb_desc_interface_t *)p)->bInterfaceNumber;
+    } else if (p[1] == TUSB_DESC_ENDPOINT) {
+      tusb_desc_endpoint_t *ep = (tusb_desc_endpoint_t *)p;
+      // Transfer type in `bmAttributes`
+      const uint8_t xfer = p[3] & 0x03;
+
+      if (xfer == TUSB_XFER_BULK) {
+        // Bulk endpoints must use the maximum packet size of the bus speed
+        const uint16_t size =
+            is_high_speed ? VENDOR_EP_SIZE_HS : VENDOR_EP_SIZE_FS;
+        p[4] = size & 0xFF;
+        p[5] = size >> 8;
+      } else if (xfer == TUSB_XFER_INTERRUPT && (ep->bEndpointAddress & 0x80))
+        // Only the IN endpoints are polled for reports
+        ep->bInterval = usb_polling_interval(polling_rates[itf], is_high_speed);
+    }
+  }
 }
 
 const uint8_t *tud_descriptor_device_cb(void) {
@@ -337,6 +441,11 @@ const uint8_t *tud_hid_descriptor_report_cb(uint8_t instance) {
     return desc_log_report;
 #endif
 
+#if defined(ANALOG_HID_ENABLED)
+  case USB_ITF_ANALOG:
+    return desc_analog_report;
+#endif
+
   default:
     // Invalid interface, should be unreachable
     return NULL;
@@ -345,7 +454,8 @@ const uint8_t *tud_hid_descriptor_report_cb(uint8_t instance) {
 
 const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
   // We only have one configuration so we don't need to check the index
-  update_desc_configuration(desc_configuration);
+  update_desc_configuration(desc_configuration,
+                            tud_speed_get() == TUSB_SPEED_HIGH);
   return desc_configuration;
 }
 
@@ -358,7 +468,8 @@ const uint8_t *tud_descriptor_other_speed_configuration_cb(uint8_t index) {
   memcpy(desc_other_speed_config, desc_configuration, CONFIG_TOTAL_LEN);
   desc_other_speed_config[1] = TUSB_DESC_OTHER_SPEED_CONFIG;
 
-  update_desc_configuration(desc_other_speed_config);
+  update_desc_configuration(desc_other_speed_config,
+                            tud_speed_get() != TUSB_SPEED_HIGH);
   return desc_other_speed_config;
 }
 #endif
@@ -378,13 +489,9 @@ const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
     break;
 
   case 0xEE:
-    // Special string index for Microsoft OS 1.0 descriptor
-    if (!eeconfig->options.xinput_enabled)
-      // If XInput is not enabled, do not return the Microsoft OS 1.0
-      // descriptor.
-      return NULL;
-
-    // Microsoft OS 1.0 descriptor
+    // Special string index for Microsoft OS 1.0 descriptor. It is returned
+    // even if XInput is not enabled since the vendor interface also requires
+    // compatibility ID.
     memcpy(desc_str, desc_ms_os_10, sizeof(desc_ms_os_10));
     return desc_str;
 
@@ -422,10 +529,18 @@ bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage,
   if (request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR &&
       request->bRequest == MS_OS_10_VENDOR_CODE) {
     switch (request->wIndex) {
-    case 0x04:
-      // Compatibility ID request
-      return tud_control_xfer(rhport, request, (void *)desc_ms_os_10_compat_id,
-                              MS_OS_10_COMPAT_ID_TOTAL_LEN);
+    case 0x04: {
+      // Compatibility ID request. Remove the XInput section if XInput is not
+      // enabled.
+      const uint32_t num_sections = eeconfig->options.xinput_enabled ? 2 : 1;
+      const uint32_t len = MS_OS_10_COMPAT_ID_DESC_LEN +
+                           num_sections * MS_OS_10_COMPAT_ID_FUNCTION_DESC_LEN;
+
+      desc_ms_os_10_compat_id[0] = len & 0xFF;
+      desc_ms_os_10_compat_id[1] = len >> 8;
+      desc_ms_os_10_compat_id[8] = num_sections;
+      return tud_control_xfer(rhport, request, desc_ms_os_10_compat_id, len);
+    }
 
     case 0x05:
       // Properties request
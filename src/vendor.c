@@ -0,0 +1,254 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "vendor.h"
+
+#include "commands.h"
+#include "eeconfig.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+// Length of the `COMMAND_WRITE_CONFIG` request before the configuration data
+#define WRITE_CONFIG_REQUEST_LEN (1 + offsetof(command_in_config_t, data))
+
+// Size of the response frame of a command
+#define RESPONSE_FRAME_SIZE (sizeof(vendor_frame_header_t) + RAW_HID_EP_SIZE)
+
+_Static_assert(RESPONSE_FRAME_SIZE <= CFG_TUD_VENDOR_TX_BUFSIZE,
+               "Vendor transmit buffer must fit a response frame");
+
+typedef enum {
+  // Receiving the frame header
+  VENDOR_STATE_HEADER = 0,
+  // Receiving the command buffer
+  VENDOR_STATE_COMMAND,
+  // Receiving the configuration data of `COMMAND_WRITE_CONFIG`
+  VENDOR_STATE_WRITE_CONFIG,
+  // Receiving the rest of a frame that is longer than the command buffer
+  VENDOR_STATE_DISCARD,
+  // Sending the configuration data of `COMMAND_READ_CONFIG`
+  VENDOR_STATE_READ_CONFIG,
+} vendor_state_t;
+
+static uint8_t state;
+static vendor_frame_header_t header;
+// Number of bytes of the header or the command buffer received
+static uint32_t received_len;
+// Number of payload bytes of the current frame not received yet
+static uint32_t frame_remaining;
+
+static uint8_t in_buf[RAW_HID_EP_SIZE];
+static uint8_t out_buf[RAW_HID_EP_SIZE];
+
+// Next configuration offset to read and the number of bytes left, or the
+// configuration offset and the length of the data to write
+static uint32_t config_offset;
+static uint32_t config_remaining;
+// Whether the configuration data of the current frame can be written, and then
+// whether it was written
+static bool config_write_success;
+// Configuration data of `COMMAND_WRITE_CONFIG`, staged until the whole frame is
+// received so that it is written and applied at once
+static uint8_t config_buf[sizeof(eeconfig_t)];
+// Whether the device must be enumerated again once the response is sent
+static bool should_reenumerate;
+
+/**
+ * @brief Send a response frame
+ *
+ * @param buf Payload
+ * @param len Length of the payload in bytes
+ *
+ * @return None
+ */
+static void vendor_send(const void *buf, uint32_t len) {
+  const vendor_frame_header_t response = {.len = len};
+
+  tud_vendor_n_write(0, &response, sizeof(response));
+  tud_vendor_n_write(0, buf, len);
+  tud_vendor_n_write_flush(0);
+}
+
+/**
+ * @brief Finish the current request
+ *
+ * @return None
+ */
+static void vendor_finish(void) {
+  state = frame_remaining > 0 ? VENDOR_STATE_DISCARD : VENDOR_STATE_HEADER;
+  received_len = 0;
+}
+
+/**
+ * @brief Execute the received command buffer
+ *
+ * @return None
+ */
+static void vendor_execute(void) {
+  const command_in_buffer_t *in = (const command_in_buffer_t *)in_buf;
+
+  if (in->command_id == COMMAND_READ_CONFIG &&
+      in->config.offset < sizeof(eeconfig_t)) {
+    // Stream the configuration instead of truncating it to the command
+    // output buffer
+    const uint8_t command_id = COMMAND_READ_CONFIG;
+    const vendor_frame_header_t response = {
+        .len = 1 + M_MIN(in->config.len,
+                         sizeof(eeconfig_t) - in->config.offset),
+    };
+
+    config_offset = in->config.offset;
+    config_remaining = response.len - 1;
+    tud_vendor_n_write(0, &response, sizeof(response));
+    tud_vendor_n_write(0, &command_id, 1);
+    state = VENDOR_STATE_READ_CONFIG;
+    return;
+  }
+
+  memset(out_buf, 0, sizeof(out_buf));
+  should_reenumerate = command_execute(in_buf, out_buf);
+  vendor_send(out_buf, sizeof(out_buf));
+  vendor_finish();
+}
+
+/**
+ * @brief Start receiving the configuration data of `COMMAND_WRITE_CONFIG`
+ *
+ * @return None
+ */
+static void vendor_write_config_begin(void) {
+  const command_in_config_t *p = &((const command_in_buffer_t *)in_buf)->config;
+
+  config_offset = p->offset;
+  config_remaining = frame_remaining;
+  // The data must be the rest of the frame
+  config_write_success = p->len == frame_remaining &&
+                         p->offset <= sizeof(eeconfig_t) &&
+                         p->len <= sizeof(eeconfig_t) - p->offset;
+  state = VENDOR_STATE_WRITE_CONFIG;
+}
+
+/**
+ * @brief Send the response of `COMMAND_WRITE_CONFIG`
+ *
+ * @return None
+ */
+static void vendor_write_config_end(void) {
+  if (config_write_success)
+    config_write_success = command_write_config(
+        config_offset, config_buf, config_remaining, &should_reenumerate);
+
+  memset(out_buf, 0, sizeof(out_buf));
+  out_buf[0] = config_write_success ? COMMAND_WRITE_CONFIG : COMMAND_UNKNOWN;
+  vendor_send(out_buf, sizeof(out_buf));
+  vendor_finish();
+}
+
+void vendor_init(void) {}
+
+void vendor_task(void) {
+  if (!tud_vendor_n_mounted(0)) {
+    // Start from a new frame on the next connection
+    state = VENDOR_STATE_HEADER;
+    received_len = 0;
+    should_reenumerate = false;
+    return;
+  }
+
+  if (should_reenumerate) {
+    if (tud_vendor_n_write_available(0) < CFG_TUD_VENDOR_TX_BUFSIZE)
+      // Wait for the response to be sent
+      return;
+    should_reenumerate = false;
+    command_reenumerate();
+    return;
+  }
+
+  if (state == VENDOR_STATE_READ_CONFIG) {
+    const uint32_t len =
+        M_MIN(config_remaining, tud_vendor_n_write_available(0));
+
+    tud_vendor_n_write(0, (const uint8_t *)eeconfig + config_offset, len);
+    config_offset += len;
+    config_remaining -= len;
+    if (config_remaining == 0) {
+      tud_vendor_n_write_flush(0);
+      vendor_finish();
+    }
+    return;
+  }
+
+  if (tud_vendor_n_write_available(0) < RESPONSE_FRAME_SIZE)
+    // Wait for room for the response of the next request
+    return;
+
+  uint8_t buf[CFG_TUD_VENDOR_EPSIZE];
+  uint32_t len;
+  switch (state) {
+  case VENDOR_STATE_HEADER:
+    received_len += tud_vendor_n_read(0, (uint8_t *)&header + received_len,
+                                      sizeof(header) - received_len);
+    if (received_len < sizeof(header))
+      break;
+
+    frame_remaining = header.len;
+    received_len = 0;
+    memset(in_buf, 0, sizeof(in_buf));
+    state = frame_remaining > 0 ? VENDOR_STATE_COMMAND : VENDOR_STATE_HEADER;
+    break;
+
+  case VENDOR_STATE_COMMAND:
+    len = M_MIN(frame_remaining, sizeof(in_buf) - received_len);
+    if (received_len < WRITE_CONFIG_REQUEST_LEN)
+      // Stop after the `COMMAND_WRITE_CONFIG` request since its configuration
+      // data is received separately
+      len = M_MIN(len, WRITE_CONFIG_REQUEST_LEN - received_len);
+
+    len = tud_vendor_n_read(0, in_buf + received_len, len);
+    received_len += len;
+    frame_remaining -= len;
+
+    if (in_buf[0] == COMMAND_WRITE_CONFIG &&
+        received_len == WRITE_CONFIG_REQUEST_LEN) {
+      vendor_write_config_begin();
+      if (frame_remaining == 0)
+        vendor_write_config_end();
+    } else if (frame_remaining == 0 || received_len == sizeof(in_buf))
+      vendor_execute();
+    break;
+
+  case VENDOR_STATE_WRITE_CONFIG:
+    if (config_write_success)
+      len = tud_vendor_n_read(
+          0, config_buf + config_remaining - frame_remaining, frame_remaining);
+    else
+      // Discard the data of an invalid request
+      len = tud_vendor_n_read(0, buf, M_MIN(frame_remaining, sizeof(buf)));
+    frame_remaining -= len;
+    if (frame_remaining == 0)
+      vendor_write_config_end();
+    break;
+
+  case VENDOR_STATE_DISCARD:
+    frame_remaining -=
+        tud_vendor_n_read(0, buf, M_MIN(frame_remaining, sizeof(buf)));
+    if (frame_remaining == 0)
+      state = VENDOR_STATE_HEADER;
+    break;
+
+  default:
+    break;
+  }
+}
@@ -266,8 +266,12 @@ void wear_leveling_init(void) {
     board_error_handler();
 }
 
+__attribute__((weak)) void wear_leveling_write_cb(uint32_t addr,
+                                                  uint32_t len) {}
+
 bool wear_leveling_erase(void) {
   wear_leveling_clear_cache();
+  wear_leveling_write_cb(0, WL_VIRTUAL_SIZE);
 
   return wear_leveling_consolidate_force() != WL_STATUS_FAILED;
 }
@@ -303,6 +307,7 @@ bool wear_leveling_write(uint32_t addr, const void *buf, uint32_t len) {
   // Update the cache first so if the cache is consolidated, we don't need to
   // continue the write operation
   memcpy(wl_cache + addr, buf8, len);
+  wear_leveling_write_cb(addr, len);
 
   wear_leveling_status_t status = wear_leveling_write_raw(addr, buf8, len);
   if (status == WL_STATUS_OK)
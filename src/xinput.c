@@ -18,6 +18,7 @@
 #include "bitmap.h"
 #include "device/usbd_pvt.h"
 #include "eeconfig.h"
+#include "lib/analog_curve.h"
 #include "lib/usqrt.h"
 #include "matrix.h"
 #include "tusb.h"
@@ -37,42 +38,6 @@ static uint8_t square_to_circular(uint8_t x, uint8_t y) {
   return (uint16_t)x * usqrt16(255 * 255 - (((uint16_t)y * y) >> 1)) / 255;
 }
 
-/**
- * @brief Apply the analog curve to the analog value
- *
- * We assume that the X coordinates are strictly increasing.
- *
- * @param value Analog value
- * @param[out] is_key_end_deadzone Whether the analog value is in the key end
- * deadzone
- *
- * @return Processed analog value
- */
-static uint8_t apply_analog_curve(uint8_t value, bool *is_key_end_deadzone) {
-  const uint8_t (*curve)[2] = CURRENT_PROFILE.gamepad_options.analog_curve;
-
-  *is_key_end_deadzone = (value > curve[3][0]);
-  if (*is_key_end_deadzone)
-    // Key end deadzone
-    return 255;
-
-  if (value <= curve[0][0])
-    // Key start deadzone
-    return 0;
-
-  // Find the segment in the curve where the value falls
-  uint8_t i = 0;
-  for (; i < 3; i++) {
-    if (curve[i + 1][0] >= value)
-      break;
-  }
-
-  const int16_t x1 = curve[i][0], y1 = curve[i][1];
-  const int16_t x2 = curve[i + 1][0], y2 = curve[i + 1][1];
-
-  return y1 + (y2 - y1) * (value - x1) / (x2 - x1);
-}
-
 // Mapping for digital gamepad buttons to XInput button bitmasks
 static const uint16_t keycode_to_bm[] = {
     [GP_BUTTON_A] = XINPUT_BUTTON_A,
@@ -154,12 +119,14 @@ void xinput_process(uint8_t key) {
 void xinput_task(void) {
   static xinput_report_t last_report = {.report_size = sizeof(xinput_report_t)};
 
+  const uint8_t (*curve)[2] = CURRENT_PROFILE.gamepad_options.analog_curve;
+
   bool is_key_end_deadzone = false;
   // Update trigger states in the report
-  report.lz =
-      apply_analog_curve(ANALOG_STATE(GP_BUTTON_LT), &is_key_end_deadzone);
-  report.rz =
-      apply_analog_curve(ANALOG_STATE(GP_BUTTON_RT), &is_key_end_deadzone);
+  report.lz = apply_analog_curve(curve, ANALOG_STATE(GP_BUTTON_LT),
+                                 &is_key_end_deadzone);
+  report.rz = apply_analog_curve(curve, ANALOG_STATE(GP_BUTTON_RT),
+                                 &is_key_end_deadzone);
 
   // lx, ly, rx, ry
   uint16_t joystick_states[4] = {0};
@@ -196,7 +163,7 @@ void xinput_task(void) {
     // Apply the analog curve to the joystick magnitude. The magnitude is
     // scaled to [0, 255] range.
     const uint32_t new_magnitude = apply_analog_curve(
-        magnitude * 255 / max_magnitude, &is_key_end_deadzone);
+        curve, magnitude * 255 / max_magnitude, &is_key_end_deadzone);
 
     if (is_key_end_deadzone) {
       // If the joystick is in the key end deadzone, we snap the axes to